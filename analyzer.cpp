@@ -0,0 +1,100 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include "analyzer.hpp"
+#include "config.hpp"
+
+Analyzer::Analyzer(bool threaded) : jobs(QUEUE_JOBS, Job{vector<int16_t>(cfg::BLOCKSIZE * cfg::CHANNELS), NULL, NULL, 0}) {
+	this->threaded = threaded;
+	this->stopping.store(false);
+	this->n_dropped.store(0);
+	if (this->threaded) {
+		sem_init(&(this->sem), 0, 0);
+		this->worker = thread(&Analyzer::work, this);
+	}
+}
+
+void Analyzer::analyze(const int16_t* block, uint8_t* slice, SeqLock* lock, size_t stage) {
+	auto t = (this->timings != NULL) ? Timings::now() : 0;
+	lock->write_begin();
+	this->spectral.analyze(block, slice);
+	lock->write_end();
+	if (this->timings != NULL) {
+		this->timings->lap(stage, t);
+	}
+}
+
+void Analyzer::submit(const int16_t* block, uint8_t* slice, SeqLock* lock, size_t stage) {
+	if (!this->threaded) {
+		this->analyze(block, slice, lock, stage);
+		return;
+	}
+	auto job = this->jobs.claim();
+	if (job == NULL) {
+		this->n_dropped.store(this->n_dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		return;
+	}
+	memcpy(job->block.data(), block, cfg::BLOCKMEMSIZE);
+	job->slice = slice;
+	job->lock = lock;
+	job->stage = stage;
+	this->jobs.publish();
+	sem_post(&(this->sem)); // async-signal-safe, does not lock
+}
+
+void Analyzer::drain() {
+	Job* job;
+	while ((job = this->jobs.peek()) != NULL) {
+		this->analyze(job->block.data(), job->slice, job->lock, job->stage);
+		this->jobs.release();
+	}
+}
+
+void Analyzer::work() {
+	while (true) {
+		while ((sem_wait(&(this->sem)) != 0) && (errno == EINTR)) {
+		}
+		if (this->stopping.load(memory_order_acquire)) {
+			break;
+		}
+		this->drain();
+	}
+	this->drain();
+}
+
+void Analyzer::stop() {
+	if (this->threaded && this->worker.joinable()) {
+		this->stopping.store(true, memory_order_release);
+		sem_post(&(this->sem));
+		this->worker.join();
+		sem_destroy(&(this->sem));
+	}
+}
+
+Analyzer::~Analyzer() {
+	this->stop();
+}
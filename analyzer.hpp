@@ -0,0 +1,55 @@
+#ifndef _ANALYZER_HPP
+#define _ANALYZER_HPP
+
+#include <atomic>
+#include <semaphore.h>
+#include <thread>
+#include <vector>
+
+#include "seqlock.hpp"
+#include "spectral.hpp"
+#include "spsc.hpp"
+#include "timings.hpp"
+
+using namespace std;
+
+// Fills spectrogram slices off sound callbacks: they submit a copy of the block with its target slice to wait-free queue
+// and post a semaphore (no locks), the worker thread analyzes. Echoes spectrogram is needed by players only at reading head,
+// DELAY after writing one, so it is always ready in time. Without thread, e.g. in offline render, analysis is done at submit().
+class Analyzer {
+
+	struct Job {
+		vector<int16_t> block;
+		uint8_t* slice;
+		SeqLock* lock; // of slice
+		size_t stage; // of timings
+	};
+
+	Spectral spectral;
+	SpscRing<Job> jobs;
+	bool threaded;
+	sem_t sem;
+	atomic<bool> stopping;
+	thread worker;
+
+	void work();
+	void analyze(const int16_t* block, uint8_t* slice, SeqLock* lock, size_t stage);
+	void drain();
+
+public:
+
+	static const size_t QUEUE_JOBS = 0x80;
+
+	Timings* timings = NULL;
+	atomic<uint64_t> n_dropped; // jobs, when queue is full
+
+	Analyzer(bool threaded);
+
+	void submit(const int16_t* block, uint8_t* slice, SeqLock* lock, size_t stage); // by the only producer thread
+	void stop(); // finishes queued jobs, then no more threaded ones
+
+	~Analyzer();
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,205 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdio.h>
+
+#include "config.hpp"
+
+using namespace std;
+
+namespace cfg {
+
+size_t CHANNELS = 2;
+size_t PLANAR = 0;
+size_t SAMPLERATE = 0x8000;
+size_t BLOCKSIZE = 0x200;
+double DURATION = 10.0;
+double DELAY = 1.0;
+double WEIGHT = 0.0625;
+int FRAMERATE = 16;
+size_t WIDTH = 1300;
+double AVERFADE_WEIGHT = 0.9;
+double SPECTRUM_FLOOR_DB = -80.0;
+double SPECTRUM_RANGE_DB = 120.0;
+double CHECKPOINT_PERIOD = 2.0;
+double HOT_SECONDS = 0.0;
+size_t RENDER_THREADS = 4;
+size_t SYNTHS = 1;
+double GOVERNOR_SHED = 0.75;
+double GOVERNOR_RESTORE = 0.4;
+size_t GOVERNOR_POLYPHONY = 64;
+
+size_t BLOCKMEMSIZE = 0;
+size_t BANDWIDTH = 0;
+size_t BLOCKS = 0;
+size_t STRIDE = 0;
+size_t SAMPLES_LANE = 0;
+size_t BINS_LANE = 0;
+size_t HOT_BLOCKS = 0;
+
+struct Param {
+	const char* name;
+	size_t* size_value; // one of these 3 is set
+	int* int_value;
+	double* double_value;
+};
+
+static const Param PARAMS[] = {
+	{"CHANNELS", &CHANNELS, NULL, NULL},
+	{"PLANAR", &PLANAR, NULL, NULL},
+	{"SAMPLERATE", &SAMPLERATE, NULL, NULL},
+	{"BLOCKSIZE", &BLOCKSIZE, NULL, NULL},
+	{"DURATION", NULL, NULL, &DURATION},
+	{"DELAY", NULL, NULL, &DELAY},
+	{"WEIGHT", NULL, NULL, &WEIGHT},
+	{"FRAMERATE", NULL, &FRAMERATE, NULL},
+	{"WIDTH", &WIDTH, NULL, NULL},
+	{"AVERFADE_WEIGHT", NULL, NULL, &AVERFADE_WEIGHT},
+	{"SPECTRUM_FLOOR_DB", NULL, NULL, &SPECTRUM_FLOOR_DB},
+	{"SPECTRUM_RANGE_DB", NULL, NULL, &SPECTRUM_RANGE_DB},
+	{"CHECKPOINT_PERIOD", NULL, NULL, &CHECKPOINT_PERIOD},
+	{"HOT_SECONDS", NULL, NULL, &HOT_SECONDS},
+	{"RENDER_THREADS", &RENDER_THREADS, NULL, NULL},
+	{"SYNTHS", &SYNTHS, NULL, NULL},
+	{"GOVERNOR_SHED", NULL, NULL, &GOVERNOR_SHED},
+	{"GOVERNOR_RESTORE", NULL, NULL, &GOVERNOR_RESTORE},
+	{"GOVERNOR_POLYPHONY", &GOVERNOR_POLYPHONY, NULL, NULL}
+};
+
+static string trim(const string& s) {
+	auto from = s.find_first_not_of(" \t\r");
+	if (from == string::npos) {
+		return string();
+	}
+	return s.substr(from, s.find_last_not_of(" \t\r") - from + 1);
+}
+
+int set(const string& name, const string& value) {
+	for (auto& param : PARAMS) {
+		if (name != param.name) {
+			continue;
+		}
+		char* end;
+		errno = 0;
+		if (param.double_value != NULL) {
+			auto v = strtod(value.c_str(), &end);
+			if ((errno == 0) && (end != value.c_str()) && (*end == 0)) {
+				*(param.double_value) = v;
+				return 0;
+			}
+		} else {
+			auto v = strtoll(value.c_str(), &end, 0); // 0x… as in config.hpp is fine
+			if ((errno == 0) && (end != value.c_str()) && (*end == 0) && (v >= 0)) {
+				if (param.size_value != NULL) {
+					*(param.size_value) = size_t(v);
+				} else {
+					*(param.int_value) = int(v);
+				}
+				return 0;
+			}
+		}
+		fprintf(stderr, "Bad value \"%s\" of %s parameter.\n", value.c_str(), name.c_str());
+		return -1;
+	}
+	fprintf(stderr, "Unknown parameter \"%s\".\n", name.c_str());
+	return -1;
+}
+
+int load(const string& path) {
+	ifstream ifs(path);
+	if (!ifs.is_open()) {
+		fprintf(stderr, "Cannot open \"%s\" config.\n", path.c_str());
+		return -1;
+	}
+	string line;
+	for (size_t i_line = 1; getline(ifs, line); i_line++) {
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) {
+			continue;
+		}
+		auto eq = line.find('=');
+		if ((eq == string::npos) || (set(trim(line.substr(0, eq)), trim(line.substr(eq + 1))) != 0)) {
+			fprintf(stderr, "… at line %lu of \"%s\" config.\n", i_line, path.c_str());
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int derive() {
+	const char* reason = NULL;
+	if ((CHANNELS == 0) || (CHANNELS > 8)) {
+		reason = "CHANNELS must be 1…8";
+	} else if (PLANAR > 1) {
+		reason = "PLANAR must be 0 or 1";
+	} else if ((SAMPLERATE < 8000) || (SAMPLERATE > 384000)) {
+		reason = "SAMPLERATE must be 8000…384000";
+	} else if ((BLOCKSIZE < 0x40) || (BLOCKSIZE > 0x4000) || ((BLOCKSIZE & (BLOCKSIZE - 1)) != 0)) {
+		reason = "BLOCKSIZE must be power of 2, 0x40…0x4000";
+	} else if ((DELAY * SAMPLERATE < BLOCKSIZE) || (DURATION < DELAY + double(BLOCKSIZE) / SAMPLERATE)) {
+		reason = "DELAY must be at least a block, and DURATION must exceed it by a block";
+	} else if (!((WEIGHT > 0.0) && (WEIGHT <= 1.0))) {
+		reason = "WEIGHT must be in (0, 1]";
+	} else if ((FRAMERATE < 1) || (FRAMERATE > 1000)) {
+		reason = "FRAMERATE must be 1…1000";
+	} else if (WIDTH <= 0x100) {
+		reason = "WIDTH must exceed 0x100";
+	} else if (!((AVERFADE_WEIGHT >= 0.0) && (AVERFADE_WEIGHT < 1.0))) {
+		reason = "AVERFADE_WEIGHT must be in [0, 1)";
+	} else if (!(SPECTRUM_RANGE_DB > 0.0)) {
+		reason = "SPECTRUM_RANGE_DB must be positive";
+	} else if (!((CHECKPOINT_PERIOD > 0.0) && (CHECKPOINT_PERIOD < DURATION))) {
+		reason = "CHECKPOINT_PERIOD must be in (0, DURATION)";
+	} else if (!((HOT_SECONDS == 0.0) || ((HOT_SECONDS >= 0.2) && (HOT_SECONDS * SAMPLERATE >= 8 * BLOCKSIZE) && (HOT_SECONDS < DURATION)))) {
+		reason = "HOT_SECONDS must be 0, or at least 0.2 and 8 blocks (tending is 4 times per HOT_SECONDS) and less than DURATION";
+	} else if ((RENDER_THREADS == 0) || (RENDER_THREADS > 64)) {
+		reason = "RENDER_THREADS must be 1…64";
+	} else if ((SYNTHS == 0) || (SYNTHS > 16)) {
+		reason = "SYNTHS must be 1…16";
+	} else if (!((GOVERNOR_RESTORE > 0.0) && (GOVERNOR_RESTORE < GOVERNOR_SHED))) {
+		reason = "GOVERNOR_RESTORE must be in (0, GOVERNOR_SHED)";
+	} else if ((GOVERNOR_POLYPHONY == 0) || (GOVERNOR_POLYPHONY > 0xFFFF)) {
+		reason = "GOVERNOR_POLYPHONY must be 1…0xFFFF";
+	}
+	if (reason != NULL) {
+		fprintf(stderr, "Bad config: %s.\n", reason);
+		return -1;
+	}
+
+	BLOCKMEMSIZE = BLOCKSIZE * CHANNELS * sizeof(int16_t);
+	BANDWIDTH = BLOCKSIZE >> 1;
+	BLOCKS = size_t(DURATION * SAMPLERATE / BLOCKSIZE);
+	STRIDE = (PLANAR != 0) ? 1 : CHANNELS;
+	SAMPLES_LANE = (PLANAR != 0) ? BLOCKSIZE : 1;
+	BINS_LANE = (PLANAR != 0) ? BANDWIDTH : 1;
+	HOT_BLOCKS = size_t(ceil(HOT_SECONDS * SAMPLERATE / BLOCKSIZE));
+	return 0;
+}
+
+}
@@ -2,26 +2,46 @@
 #define _CONFIG_HPP
 
 #include <memory>
+#include <string>
 
 namespace cfg {
 
-// Primary
-
-const size_t CHANNELS = 2;
-const size_t SAMPLERATE = 0x8000;
-const size_t BLOCKSIZE = 0x200;
-const double DURATION = 10.0; // sec
-const double DELAY = 1.0; // sec, from "reading head" to "writing head"
-const double WEIGHT = 0.0625;
-const int FRAMERATE = 16;
-const size_t WIDTH = 1300; // > 0x100, the width of momentary spectrum
-const double AVERFADE_WEIGHT = 0.9;
+// Primary, defaults are in config.cpp; may be changed at start only, by load() and set(), followed by derive()
+
+extern size_t CHANNELS;
+extern size_t PLANAR; // 1 - blocks & slices are lanes of channels one after another, 0 - interleaved as at devices & files
+extern size_t SAMPLERATE;
+extern size_t BLOCKSIZE; // power of 2
+extern double DURATION; // sec
+extern double DELAY; // sec, from "reading head" to "writing head"
+extern double WEIGHT;
+extern int FRAMERATE;
+extern size_t WIDTH; // > 0x100, the width of momentary spectrum
+extern double AVERFADE_WEIGHT;
+extern double SPECTRUM_FLOOR_DB; // energy spectral density of luminance 0 in spectrograms
+extern double SPECTRUM_RANGE_DB; // from luminance 0 to 0xFF
+extern double CHECKPOINT_PERIOD; // sec, < DURATION, of flushing echoes to disk
+extern double HOT_SECONDS; // of echoes kept uncompressed ahead of each head, the rest is compressed in memory; 0 - none compressed
+extern size_t RENDER_THREADS; // composing window image, including the main one
+extern size_t SYNTHS; // instances players are spread over, rendered in parallel, including by the sound thread
+extern double GOVERNOR_SHED; // share of block duration taken by sound output callback, above it work is shed
+extern double GOVERNOR_RESTORE; // < GOVERNOR_SHED, below it for a second, work is restored
+extern size_t GOVERNOR_POLYPHONY; // voices of each synth, when lowered
 
 // Derived
 
-const size_t BLOCKMEMSIZE = BLOCKSIZE * CHANNELS * sizeof(int16_t);
-const size_t BANDWIDTH = BLOCKSIZE >> 1;
-const size_t BLOCKS = size_t(DURATION * SAMPLERATE / BLOCKSIZE);
+extern size_t BLOCKMEMSIZE;
+extern size_t BANDWIDTH;
+extern size_t BLOCKS;
+extern size_t STRIDE; // between consecutive samples (bins) of a channel in block (slice)
+extern size_t SAMPLES_LANE; // between 1st samples of consecutive channels in block
+extern size_t BINS_LANE; // between 1st bins of consecutive channels in slice
+extern size_t HOT_BLOCKS; // of HOT_SECONDS
+
+// Each returns 0, or -1 after printing the reason to stderr
+int set(const std::string& name, const std::string& value);
+int load(const std::string& path); // lines of NAME = VALUE, # starts comment
+int derive(); // checks primary parameters
 
 }
 
@@ -1,17 +1,177 @@
 #ifndef _CONTROLLER_HPP
 #define _CONTROLLER_HPP
 
+#include <atomic>
+#include <cstring>
+
+#include "config.hpp"
 #include "ensemble.hpp"
 #include "echoes.hpp"
+#include "governor.hpp"
+#include "interleaver.hpp"
+#include "latency.hpp"
+#include "spsc.hpp"
+#include "timings.hpp"
 
+// Sound input and output run on independent clocks, usually in different threads. Input thread only passes blocks
+// through the ring to output thread, which alone moves both heads of echoes, so {W-R} stays at DELAY exactly,
+// and clock drift shows up as the ring's fill drifting instead. It is corrected by skipping a write
+// when the ring is empty (input is behind), and by dropping the oldest blocks when it is over-filled (input is ahead).
+// Duplex stream has one clock and one callback, so there input is written to echoes directly.
+// Blocks passed in and out are interleaved frames of devices and files, converted to cfg layout here.
 struct Controller {
+	static const size_t INPUT_RING_BLOCKS = 8;
+	static const size_t INPUT_RING_MAX_FILL = 4; // above it, input is considered ahead
+
 	Ensemble* ensemble;
 	Echoes* echoes;
-	int sync_stage = -2;
-	bool do_synth_out = true;
-	bool do_echoes_out = false;
+	Timings* timings = NULL;
+	Governor* governor = NULL; // gets time of output callbacks, if set
+	LatencyProbe* probe = NULL; // replaces processing of duplex stream, if set
+
+	atomic<bool> synced; // writing head is set DELAY after reading one by the 1st output block
+	atomic<bool> do_synth_out;
+	atomic<bool> do_echoes_out;
+
+	SpscRing<vector<int16_t>> input_ring;
+	bool input_primed = false; // output side, became true at the 1st block from the ring
+
+	Interleaver interleaver;
+	vector<int16_t> output_block; // of cfg layout, if PLANAR, to interleave to device from
+	vector<int16_t> duplex_input_block; // same, to deinterleave from device to
+
+	// Counters, each written by one thread
+	atomic<uint64_t> n_in_blocks; // input, since sync
+	atomic<uint64_t> n_out_blocks; // output, since sync
+	atomic<uint64_t> n_dropped; // output, input blocks dropped due to over-fill
+	atomic<uint64_t> n_skipped; // output, writes skipped due to empty ring
+	atomic<uint64_t> n_overflows; // input, blocks lost due to full ring, when output stalls
+
+	Controller(Ensemble* ensemble, Echoes* echoes) : ensemble(ensemble), echoes(echoes), input_ring(INPUT_RING_BLOCKS, vector<int16_t>(cfg::BLOCKSIZE * cfg::CHANNELS)), output_block(cfg::BLOCKSIZE * cfg::CHANNELS), duplex_input_block(cfg::BLOCKSIZE * cfg::CHANNELS) {
+		this->synced.store(false);
+		this->do_synth_out.store(true);
+		this->do_echoes_out.store(false);
+		this->n_in_blocks.store(0);
+		this->n_out_blocks.store(0);
+		this->n_dropped.store(0);
+		this->n_skipped.store(0);
+		this->n_overflows.store(0);
+	}
+
+	// Block processing shared by sound streams and offline render
+
+	void process_input(int16_t* input) {
+		auto t = (this->timings != NULL) ? Timings::now() : 0;
+		if (this->synced.load(memory_order_acquire)) {
+			auto slot = this->input_ring.claim();
+			if (slot != NULL) {
+				this->interleaver.deinterleave(input, slot->data());
+				this->input_ring.publish();
+			} else {
+				this->n_overflows.store(this->n_overflows.load(memory_order_relaxed) + 1, memory_order_relaxed);
+			}
+			this->n_in_blocks.store(this->n_in_blocks.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		}
+		if (this->timings != NULL) {
+			this->timings->lap(Timings::IN_CALLBACK, t);
+		}
+	}
+
+	void process_output(int16_t* frames) {
+		auto t = ((this->timings != NULL) || (this->governor != NULL)) ? Timings::now() : 0;
+		auto output = (cfg::PLANAR != 0) ? this->output_block.data() : frames;
+		this->ensemble->react_and_read(this->echoes->spectrogram, this->echoes->pos_blk_read.load(memory_order_relaxed), output); // updates slice of synth spectrogram, inter alia
+		if (!this->do_synth_out.load(memory_order_relaxed)) {
+			memset(output, 0, cfg::BLOCKMEMSIZE);
+		}
+		this->echoes->read_add(output, !this->do_echoes_out.load(memory_order_relaxed));
+		if (cfg::PLANAR != 0) {
+			this->interleaver.interleave(output, frames);
+		}
+		if (this->synced.load(memory_order_relaxed)) {
+			this->write_echoes();
+			this->n_out_blocks.store(this->n_out_blocks.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		} else {
+			this->echoes->sync_pos_blk_write();
+			this->synced.store(true, memory_order_release);
+		}
+		if (this->timings != NULL) {
+			this->timings->lap(Timings::OUT_CALLBACK, t);
+		}
+		if (this->governor != NULL) {
+			this->governor->update(Timings::now() - t);
+		}
+	}
+
+	// Of duplex stream: write, react and read, in this order
+	void process_duplex(const int16_t* in_frames, int16_t* out_frames) {
+		auto t = ((this->timings != NULL) || (this->governor != NULL)) ? Timings::now() : 0;
+		if (this->probe != NULL) {
+			this->probe->process(in_frames, out_frames);
+		} else {
+			auto input = in_frames;
+			auto output = out_frames;
+			if (cfg::PLANAR != 0) {
+				if (in_frames != NULL) {
+					this->interleaver.deinterleave(in_frames, this->duplex_input_block.data());
+					input = this->duplex_input_block.data();
+				}
+				output = this->output_block.data();
+			}
+			if (this->synced.load(memory_order_relaxed)) {
+				if (input != NULL) {
+					this->echoes->write(input);
+				} else {
+					this->echoes->skip_write();
+				}
+				this->n_in_blocks.store(this->n_in_blocks.load(memory_order_relaxed) + 1, memory_order_relaxed);
+				this->n_out_blocks.store(this->n_out_blocks.load(memory_order_relaxed) + 1, memory_order_relaxed);
+			}
+			this->ensemble->react_and_read(this->echoes->spectrogram, this->echoes->pos_blk_read.load(memory_order_relaxed), output);
+			if (!this->do_synth_out.load(memory_order_relaxed)) {
+				memset(output, 0, cfg::BLOCKMEMSIZE);
+			}
+			this->echoes->read_add(output, !this->do_echoes_out.load(memory_order_relaxed));
+			if (cfg::PLANAR != 0) {
+				this->interleaver.interleave(output, out_frames);
+			}
+			if (!this->synced.load(memory_order_relaxed)) {
+				this->echoes->sync_pos_blk_write();
+				this->synced.store(true, memory_order_release);
+			}
+		}
+		if (this->timings != NULL) {
+			this->timings->lap(Timings::OUT_CALLBACK, t);
+		}
+		if (this->governor != NULL) {
+			this->governor->update(Timings::now() - t);
+		}
+	}
+
+	void write_echoes() {
+		while (this->input_ring.size() > INPUT_RING_MAX_FILL) {
+			this->input_ring.release();
+			this->n_dropped.store(this->n_dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		}
+		auto block = this->input_ring.peek();
+		if (block != NULL) {
+			this->echoes->write(block->data()); // updates slice of echoes spectrogram, inter alia
+			this->input_ring.release();
+			this->input_primed = true;
+		} else {
+			this->echoes->skip_write();
+			if (this->input_primed) {
+				this->n_skipped.store(this->n_skipped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+			}
+		}
+	}
 
-	Controller(Ensemble* ensemble, Echoes* echoes) : ensemble(ensemble), echoes(echoes) {}
+	// Rate of input clock relative to output one, minus 1, in parts per million, from block counts since sync
+	double get_drift_ppm() {
+		auto n_out = this->n_out_blocks.load(memory_order_relaxed);
+		auto n_in = this->n_in_blocks.load(memory_order_relaxed);
+		return (n_out == 0) ? 0.0 : (1e6 * (double(n_in) - double(n_out)) / n_out);
+	}
 };
 
 #endif
\ No newline at end of file
@@ -22,136 +22,248 @@ You should have received a copy of the GNU General Public License
 along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <opencv2/core.hpp>
-
-#include <dirent.h>
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdio.h>
 #include <sys/stat.h>
 
 #include "config.hpp"
 #include "echoes.hpp"
+#include "kernels.hpp"
+#include "spectral.hpp"
 
 const char* RUN_DIRNAME = "_run_";
-const char* COUNTERS_FILENAME = "counters.bin";
-const char* DATA_FILENAME = "data.bin";
-const char* SPECTROGRAM_FILENAME = "spectrogram.bin";
 
 Echoes::Echoes() {
-	this->pos_blk_read = 0;
-	this->pos_blk_write = 0;
-	this->runtime = 0;
-	this->data = vector<int16_t>(cfg::BLOCKS * cfg::BLOCKSIZE * cfg::CHANNELS);
-	this->spectrogram = vector<uint8_t>(cfg::BLOCKS * cfg::BANDWIDTH * cfg::CHANNELS);
-	this->block1d = vector<double>(cfg::BLOCKSIZE);
-	this->spectrum = vector<double>(cfg::BLOCKSIZE);
+	this->pos_blk_read.store(0);
+	this->pos_blk_write.store(0);
+	this->runtime.store(0);
+	this->run.open_anonymous();
+	this->data = this->run.data;
+	this->spectrogram = this->run.spectrogram;
+	this->spectrogram_locks = unique_ptr<SeqLock[]>(new SeqLock[cfg::BLOCKS]);
+	if (cfg::HOT_BLOCKS > 0) {
+		this->tiers.reset(new TieredStore(&(this->pos_blk_read)));
+	}
 }
 
 void Echoes::read_add(int16_t* output, bool silence) {
+	auto t = (this->timings != NULL) ? Timings::now() : 0;
+	auto pos_blk = this->pos_blk_read.load(memory_order_relaxed);
 	if (!silence) {
-		auto src = this->data.data() + this->pos_blk_read * cfg::BLOCKSIZE * cfg::CHANNELS;
-		for (size_t i = 0; i < cfg::BLOCKSIZE; i++) {
-			for (size_t j = 0; j < cfg::CHANNELS; j++) {
-				*output += *src;
-				src++;
-				output++;
-			}
+		auto block = this->tiers ? this->tiers->get(pos_blk, false) : (this->data + pos_blk * cfg::BLOCKSIZE * cfg::CHANNELS);
+		if (block != NULL) {
+			kernels::add(output, block, cfg::BLOCKSIZE * cfg::CHANNELS);
 		}
 	}
-	this->pos_blk_read++;
-	if (this->pos_blk_read == cfg::BLOCKS) {
-		this->pos_blk_read = 0;
+	pos_blk++;
+	if (pos_blk == cfg::BLOCKS) {
+		pos_blk = 0;
+	}
+	this->pos_blk_read.store(pos_blk, memory_order_release);
+	if (this->timings != NULL) {
+		this->timings->lap(Timings::ECHOES_READ, t);
 	}
 }
 
-void Echoes::write(int16_t* input) {
-	auto dst_start = this->data.data() + this->pos_blk_write * cfg::BLOCKSIZE * cfg::CHANNELS;
-
-	auto dst = dst_start;
-	for (size_t i = 0; i < cfg::BLOCKSIZE; i++) {
-		for (size_t c = 0; c < cfg::CHANNELS; c++) {
-			(*dst) = int16_t(cfg::WEIGHT * (*input) + (1.0 - cfg::WEIGHT) * (*dst));
-			dst++;
-			input++;
-		}			
-	}
-
-	// Update slice of spectrogram
-	double scale = 1.0 / 32768.0;
-	double re, im, lum;
-	for (size_t c = 0; c < cfg::CHANNELS; c++) {
-		dst = dst_start + c;
-		auto blk = this->block1d.data();
-		for (size_t i = 0; i < cfg::BLOCKSIZE; i++) {
-			*blk = double(*dst) * scale;
-			blk++;
-			dst += cfg::CHANNELS; 
-		}
-		cv::dft(this->block1d, this->spectrum);
-		auto spc = this->spectrum.data() + 1; // skip "freq 0"
-		auto spg = this->spectrogram.data() + (this->pos_blk_write) * (cfg::BANDWIDTH * cfg::CHANNELS) + c;
-		for (size_t i = 0; i < cfg::BANDWIDTH; i++) {
-			re = (*spc);
-			im = ((i + 1) < cfg::BANDWIDTH) ? (*(spc + 1)) : 0.0;
-			lum = (8 + log10(1e-8 + re * re + im * im)) / 12;
-			if (lum > 1.0) {
-				lum = 1.0;
-			}
-			*spg = uint8_t(0xFF * lum);
-			spc += 2;
-			spg += cfg::CHANNELS;
-		}
+void Echoes::write(const int16_t* input) {
+	auto t = (this->timings != NULL) ? Timings::now() : 0;
+
+	auto pos_blk = this->pos_blk_write.load(memory_order_relaxed);
+	auto dst_start = this->tiers ? this->tiers->get(pos_blk, true) : (this->data + pos_blk * cfg::BLOCKSIZE * cfg::CHANNELS);
+	if (dst_start == NULL) { // still packed and not rescued, input is lost
+		this->skip_write();
+		return;
+	}
+
+	kernels::mix(dst_start, input, cfg::BLOCKSIZE * cfg::CHANNELS);
+
+	if (this->timings != NULL) {
+		this->timings->lap(Timings::ECHOES_MIX, t);
 	}
 
-	this->pos_blk_write++;
-	if (this->pos_blk_write == cfg::BLOCKS) {
-		this->pos_blk_write = 0;
+	// Update slice of spectrogram, asynchronously
+	if (this->analyzer != NULL) {
+		this->analyzer->submit(dst_start, this->spectrogram + pos_blk * (cfg::BANDWIDTH * cfg::CHANNELS), &(this->spectrogram_locks[pos_blk]), Timings::ECHOES_ANALYSIS);
 	}
+
+	this->skip_write();
+}
+
+void Echoes::skip_write() {
+	auto pos_blk = this->pos_blk_write.load(memory_order_relaxed) + 1;
+	if (pos_blk == cfg::BLOCKS) {
+		pos_blk = 0;
+	}
+	this->pos_blk_write.store(pos_blk, memory_order_release);
 }
 
 void Echoes::sync_pos_blk_write() {
-	this->pos_blk_write = (this->pos_blk_read + size_t(cfg::DELAY * cfg::SAMPLERATE) / cfg::BLOCKSIZE) % cfg::BLOCKS;
+	this->pos_blk_write.store((this->pos_blk_read.load(memory_order_relaxed) + size_t(cfg::DELAY * cfg::SAMPLERATE) / cfg::BLOCKSIZE) % cfg::BLOCKS, memory_order_release);
 }
 
-void Echoes::save() {
-	mkdir(RUN_DIRNAME, 0777);
+void Echoes::checkpoint(size_t pos_blk_from, size_t pos_blk_to) {
+	// Analysis of the block lags behind its writing, by the queue of analyzer at most
+	size_t n_blks = (cfg::BLOCKS + pos_blk_to - pos_blk_from) % cfg::BLOCKS;
+	size_t n_blks_sg = min(n_blks + Analyzer::QUEUE_JOBS, cfg::BLOCKS);
+	size_t pos_blk_from_sg = (cfg::BLOCKS + pos_blk_to - n_blks_sg) % cfg::BLOCKS;
 
-	ofstream ofs;
-	ofs.open(string(RUN_DIRNAME) + "/" + string(COUNTERS_FILENAME), ios::binary | ios::out);
-	ofs.write((char*)&(this->pos_blk_read), sizeof(this->pos_blk_read));
-	ofs.write((char*)&(this->runtime), sizeof(this->runtime));
-	ofs.close();
+	for (size_t i = 0; i < n_blks; i++) {
+		auto pos_blk = (pos_blk_from + i) % cfg::BLOCKS;
+		if (this->tiers) {
+			this->tiers->read(pos_blk, this->data + pos_blk * cfg::BLOCKSIZE * cfg::CHANNELS);
+		}
+		this->run.update_checksum(RunFile::DATA, pos_blk);
+	}
+	for (size_t i = 0; i < n_blks_sg; i++) {
+		this->run.update_checksum(RunFile::SPECTROGRAM, (pos_blk_from_sg + i) % cfg::BLOCKS);
+	}
+	this->run.sync(RunFile::DATA, pos_blk_from, n_blks);
+	this->run.sync(RunFile::SPECTROGRAM, pos_blk_from_sg, n_blks_sg);
+	this->run.sync(RunFile::CHECKSUMS, 0, cfg::BLOCKS);
+	this->run.commit(this->pos_blk_read.load(memory_order_acquire), pos_blk_to, this->runtime.load(memory_order_relaxed));
+	if (this->tiers) {
+		this->run.release(RunFile::DATA, pos_blk_from, n_blks); // already in tiers
+	}
+}
 
-	ofs.open(string(RUN_DIRNAME) + "/" + string(DATA_FILENAME), ios::binary | ios::out);
-	ofs.write((char *)this->data.data(), cfg::BLOCKS * cfg::BLOCKSIZE * cfg::CHANNELS * sizeof(int16_t));
-	ofs.close();
+void Echoes::start_checkpoints() {
+	if (!this->persistent) {
+		return;
+	}
+	this->pos_blk_checkpointed = this->pos_blk_write.load(memory_order_acquire);
+	this->checkpointer_stopping = false;
+	this->checkpointer = thread([this]() {
+		unique_lock<mutex> lock(this->checkpointer_mutex);
+		while (!this->checkpointer_cv.wait_for(lock, chrono::milliseconds(int(1000 * cfg::CHECKPOINT_PERIOD)), [this]() { return this->checkpointer_stopping; })) {
+			// Blocks before writing head are complete, except for analysis
+			auto pos_blk = this->pos_blk_write.load(memory_order_acquire);
+			this->checkpoint(this->pos_blk_checkpointed, pos_blk);
+			this->pos_blk_checkpointed = pos_blk;
+		}
+	});
+}
+
+void Echoes::stop_checkpoints() {
+	if (this->checkpointer.joinable()) {
+		{
+			lock_guard<mutex> lock(this->checkpointer_mutex);
+			this->checkpointer_stopping = true;
+		}
+		this->checkpointer_cv.notify_one();
+		this->checkpointer.join();
+	}
+}
 
-	ofs.open(string(RUN_DIRNAME) + "/" + string(SPECTROGRAM_FILENAME), ios::binary | ios::out);
-	ofs.write((char *)this->spectrogram.data(), cfg::BLOCKS * cfg::BANDWIDTH * cfg::CHANNELS);
-	ofs.close();
+void Echoes::save() {
+	if (!this->persistent) {
+		return;
+	}
+	auto pos_blk = this->pos_blk_write.load(memory_order_acquire);
+	this->checkpoint(this->pos_blk_checkpointed, pos_blk);
+	this->pos_blk_checkpointed = pos_blk;
 }
 
-int Echoes::load() {
-	DIR* drun;
-	if ((drun = opendir(RUN_DIRNAME)) == NULL) {
+int Echoes::load(bool persist) {
+	if (persist) {
+		mkdir(RUN_DIRNAME, 0777);
+	}
+
+	auto result = this->run.open(RUN_DIRNAME, persist);
+	if (result < 0) {
+		fprintf(stderr, "Cannot open echoes in \"%s\" dir, they will not be saved.\n", RUN_DIRNAME);
+		this->run.open_anonymous();
+	} else if (result == 1) {
+		fprintf(stderr, "Echoes were saved in other format or with other parameters, converted.\n");
+	}
+	this->data = this->run.data;
+	this->spectrogram = this->run.spectrogram;
+	this->persistent = persist && (result >= 0);
+
+	if ((result != 0) && (result != 1)) {
 		return -1;
-	} else {
-		closedir(drun);
 	}
 
-	ifstream ifs;
-	ifs.open(string(RUN_DIRNAME) + "/" + string(COUNTERS_FILENAME), ios::binary | ios::in);
-	ifs.read((char*)&(this->pos_blk_read), sizeof(this->pos_blk_read));
-	ifs.read((char*)&(this->runtime), sizeof(this->runtime));
-	ifs.close();
-	this->pos_blk_read = this->pos_blk_read % cfg::BLOCKS; // untrusted input...
+	// Only blocks written after the last commit may fail checksums: from its writing head on, within 2 periods of checkpoints
+	// (of this run's CHECKPOINT_PERIOD), and slices lagging behind by the queue of analyzer. Samples of those are newer than the commit,
+	// and a torn block is still the loop's sound, so they are kept with checksums and spectrogram recomputed; failing blocks before
+	// the head are damaged, and zeroed. Converted state has checksums of samples only, and its whole spectrogram is recomputed
+	size_t pos_blk_from = 0;
+	size_t n_blks = cfg::BLOCKS;
+	size_t n_committed = 0; // of the blocks checked, those before writing head of the commit
+	if (result == 0) {
+		n_committed = min(Analyzer::QUEUE_JOBS, cfg::BLOCKS);
+		n_blks = min(size_t(2 * cfg::CHECKPOINT_PERIOD * cfg::SAMPLERATE) / cfg::BLOCKSIZE + 2 * Analyzer::QUEUE_JOBS, cfg::BLOCKS);
+		pos_blk_from = (cfg::BLOCKS + this->run.pos_blk_write - n_committed) % cfg::BLOCKS;
+	}
+	Spectral spectral;
+	size_t n_kept = 0;
+	size_t n_zeroed = 0;
+	for (size_t i = 0; i < n_blks; i++) {
+		auto pos_blk = (pos_blk_from + i) % cfg::BLOCKS;
+		auto block = this->data + pos_blk * cfg::BLOCKSIZE * cfg::CHANNELS;
+		bool failed = !this->run.verify(RunFile::DATA, pos_blk);
+		if (failed) {
+			if (i < n_committed) {
+				memset(block, 0, cfg::BLOCKMEMSIZE);
+				n_zeroed++;
+			} else {
+				n_kept++;
+			}
+			this->run.update_checksum(RunFile::DATA, pos_blk);
+		}
+		if (failed || (result == 1) || !this->run.verify(RunFile::SPECTROGRAM, pos_blk)) {
+			spectral.analyze(block, this->spectrogram + pos_blk * cfg::BANDWIDTH * cfg::CHANNELS);
+			this->run.update_checksum(RunFile::SPECTROGRAM, pos_blk);
+		}
+	}
+	if (n_kept > 0) {
+		fprintf(stderr, "%lu blocks of echoes were written after the last checkpoint, kept.\n", n_kept);
+	}
+	if (n_zeroed > 0) {
+		fprintf(stderr, "%lu blocks of echoes failed checksums (damaged), zeroed.\n", n_zeroed);
+	}
 
-	ifs.open(string(RUN_DIRNAME) + "/" + string(DATA_FILENAME), ios::binary | ios::in);
-	ifs.read((char *)this->data.data(), cfg::BLOCKS * cfg::BLOCKSIZE * cfg::CHANNELS * sizeof(int16_t));
-	ifs.close();
+	this->pos_blk_read.store(this->run.pos_blk_read);
+	this->runtime.store(this->run.runtime);
+	this->sync_pos_blk_write();
+	if (this->persistent) { // so that blocks to be written first are verified after a crash, even if DELAY has changed
+		this->run.sync(RunFile::DATA, pos_blk_from, n_blks);
+		this->run.sync(RunFile::SPECTROGRAM, pos_blk_from, n_blks);
+		this->run.sync(RunFile::CHECKSUMS, 0, cfg::BLOCKS);
+		this->run.commit(this->run.pos_blk_read, this->pos_blk_write.load(), this->run.runtime);
+	}
 
-	ifs.open(string(RUN_DIRNAME) + "/" + string(SPECTROGRAM_FILENAME), ios::binary | ios::in);
-	ifs.read((char *)this->spectrogram.data(), cfg::BLOCKS * cfg::BANDWIDTH * cfg::CHANNELS);
-	ifs.close();
+	if (this->tiers) {
+		for (size_t i = 0; i < cfg::BLOCKS; i++) {
+			this->tiers->load(i, this->data + i * cfg::BLOCKSIZE * cfg::CHANNELS);
+		}
+		this->run.release(RunFile::DATA, 0, cfg::BLOCKS);
+	}
+	this->tend();
 
 	return 0;
 }
+
+void Echoes::start_tending() {
+	if (this->tiers) {
+		this->tiers->start();
+	}
+}
+
+void Echoes::stop_tending() {
+	if (this->tiers) {
+		this->tiers->stop();
+	}
+}
+
+void Echoes::tend() {
+	if (this->tiers) {
+		this->tiers->tend();
+	}
+}
+
+Echoes::~Echoes() {
+	this->stop_checkpoints();
+}
\ No newline at end of file
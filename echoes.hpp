@@ -1,31 +1,68 @@
 #ifndef _ECHOES_HPP
 #define _ECHOES_HPP
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#include "analyzer.hpp"
+#include "runfile.hpp"
+#include "seqlock.hpp"
+#include "tiered.hpp"
+#include "timings.hpp"
+
 using namespace std;
 
 class Echoes {
 
-	vector<int16_t> data;
-	vector<double> block1d; // to avoid allocations in callback
-	vector<double> spectrum; // to avoid allocations in callback
+	RunFile run;
+	int16_t* data;
+	bool persistent = false; // mapped from file of run, shared
+
+	// Checkpointing thread
+	size_t pos_blk_checkpointed = 0; // writing head at previous checkpoint
+	thread checkpointer;
+	mutex checkpointer_mutex;
+	condition_variable checkpointer_cv;
+	bool checkpointer_stopping = false;
+
+	void checkpoint(size_t pos_blk_from, size_t pos_blk_to);
 
 public:
 
-	size_t pos_blk_read;
-	size_t pos_blk_write;
-	int64_t runtime; // microseconds
-	vector<uint8_t> spectrogram;
+	// Both are advanced by the thread of sound output only (released), and read by others (acquired)
+	atomic<size_t> pos_blk_read;
+	atomic<size_t> pos_blk_write;
+	atomic<int64_t> runtime; // microseconds
+	uint8_t* spectrogram;
+	unique_ptr<SeqLock[]> spectrogram_locks; // per block, for tear-free copies by UI
+	Timings* timings = NULL;
+	Analyzer* analyzer = NULL; // fills spectrogram, if set
+	unique_ptr<TieredStore> tiers; // holds samples instead of file of run, if HOT_SECONDS > 0; the file gets them at checkpoints only
 
-	Echoes();
+	Echoes(); // silent, not backed by files
 
 	void read_add(int16_t* output, bool silence);
-	void write(int16_t* input);
+	void write(const int16_t* input);
+	void skip_write(); // advances writing head only, leaving echoes there as they are
 	void sync_pos_blk_write();
-	void save();
-	int load();
+
+	// Maps file of run instead of copying it, returns 0 if state was there (converted, if saved with other parameters).
+	// With persist, file is created if absent, and changes go to it; otherwise, changes are private and lost (as in offline render).
+	// Blocks failing their checksums are reported: kept if written after the last commit, zeroed if damaged before it;
+	// their spectrogram is recomputed
+	int load(bool persist);
+	void start_checkpoints(); // periodically flushes blocks written since previous checkpoint with their checksums, then commits counters
+	void stop_checkpoints();
+	void save(); // the last checkpoint
+	void start_tending(); // of tiers, if any, on own thread
+	void stop_tending();
+	void tend(); // of tiers, if any, once by the caller
+
+	~Echoes();
 
 };
 
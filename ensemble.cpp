@@ -23,36 +23,64 @@ along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <fluidsynth.h>
-#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 
 #include "ensemble.hpp"
-#include "players/drummer.hpp"
-#include "players/flutist.hpp"
-#include "players/pianist.hpp"
-#include "players/singer.hpp"
+#include "fastpath.hpp"
+#include "kernels.hpp"
 #include "soundfonts.hpp"
-#include "spectrumstats.hpp"
+
+template class StaticEnsemble<Drummer, Flutist, Pianist, Singer>;
+
+const char* const DynamicEnsemble::PLAYER_NAMES[] = {"drummer", "flutist", "pianist", "singer"};
 
 template<class P>
-void Ensemble::add_player() {
+void DynamicEnsemble::add_player() {
 #ifdef _cpp_lib_make_unique // compiler supports C++14 or later
-	this->players.push_back(make_unique<P>(this->synth, this->sfids, this->new_channel));
+	this->players.push_back(make_unique<P>(this->new_channel));
 #else // compiler supports only C++11
-	this->players.push_back(move(unique_ptr<P>(new P(this->synth, this->sfids, this->new_channel))));
+	this->players.push_back(move(unique_ptr<P>(new P(this->new_channel))));
 #endif
 }
 
 Ensemble::Ensemble() {
 	this->fls_settings = new_fluid_settings();
 	fluid_settings_setnum(this->fls_settings, "synth.sample-rate", cfg::SAMPLERATE);
-	this->synth = new_fluid_synth(this->fls_settings);
+	// Samples are loaded only for presets selected at some channel, i.e. players' programs
+	if (fluid_settings_setint(this->fls_settings, "synth.dynamic-sample-loading", 1) != FLUID_OK) {
+		fprintf(stderr, "FluidSynth has no dynamic sample loading, whole soundfonts will be loaded.\n");
+	}
+	// Default is 16, less than players may take
+	if (fluid_settings_setint(this->fls_settings, "synth.midi-channels", MIDI_CHANNELS) != FLUID_OK) {
+		fprintf(stderr, "FluidSynth cannot have %d MIDI channels.\n", MIDI_CHANNELS);
+	}
+	for (size_t j = 0; j < cfg::SYNTHS; j++) {
+		this->synths.push_back(new_fluid_synth(this->fls_settings));
+		this->outs.push_back(MidiOut(this->synths[j]));
+	}
+	this->synth = this->synths[0];
+	this->polyphony = fluid_synth_get_polyphony(this->synth);
+	this->loading_synth = new_fluid_synth(this->fls_settings);
+	this->sfloader = unique_ptr<SoundfontLoader>(new SoundfontLoader(this->loading_synth, this->fls_settings));
+	this->chan_synths = vector<size_t>(MIDI_CHANNELS, 0);
 
-	this->new_channel = 0;
+	if (this->synths.size() > 1) {
+		this->render_workers = unique_ptr<ForkJoin>(new ForkJoin(this->synths.size()));
+		this->synth_blocks = vector<vector<int16_t>>(this->synths.size(), vector<int16_t>(cfg::BLOCKSIZE * cfg::CHANNELS));
+	}
+	this->synth_rights = vector<vector<int16_t>>(this->synths.size(), vector<int16_t>((cfg::CHANNELS == 1) ? cfg::BLOCKSIZE : 0));
+	this->render_fn = [this](size_t j) {
+		auto block = (j == 0) ? this->render_output : this->synth_blocks[j].data();
+		write_synth(this->synths[j], block, this->synth_rights[j].data());
+	};
 
-	this->block1d = vector<double>(cfg::BLOCKSIZE);
-	this->spectrum = vector<double>(cfg::BLOCKSIZE);
+	this->new_channel = 0;
 
-	this->pos_blk = 0;
+	this->pos_blk.store(0);
 
 	this->sliding_averfade_spectrum = vector<uint8_t>(cfg::BANDWIDTH);
 	this->spectrogram = vector<uint8_t>(cfg::WIDTH * cfg::BANDWIDTH * cfg::CHANNELS);
@@ -63,89 +91,371 @@ Ensemble::Ensemble() {
 	}
 	auto soundfonts_dirpath_str = (soundfonts_dirpath == NULL) ? string() : string(soundfonts_dirpath);
 	for (auto fname : SOUNDFONTS_FILENAMES) {
-		auto fpath = soundfonts_dirpath_str + "/" + fname;
-		this->sfids.push_back(fluid_synth_sfload(this->synth, fpath.c_str(), 0));
+		this->soundfont_paths.push_back(soundfonts_dirpath_str + "/" + fname);
+	}
+	this->sfids = vector<vector<int>>(this->synths.size(), vector<int>(this->soundfont_paths.size(), FLUID_FAILED));
+	this->loading_sfids = vector<int>(this->soundfont_paths.size(), FLUID_FAILED);
+	this->soundfonts_settled = vector<bool>(this->soundfont_paths.size(), false);
+
+	this->n_players = 0;
+	this->online.store(0);
+
+	this->spectrogram_locks = unique_ptr<SeqLock[]>(new SeqLock[cfg::WIDTH]);
+	this->eventogram_locks = unique_ptr<SeqLock[]>(new SeqLock[cfg::WIDTH]);
+
+	this->averfade_fn = select_fastpath<Averfade>();
+}
+
+void Ensemble::init_players(const vector<Player*>& players) {
+	this->n_players = players.size();
+	this->eventogram = vector<uint8_t>(cfg::WIDTH * this->n_players * 3);
+
+	vector<vector<Player::Cue>> cues;
+	size_t n_slots = 1;
+	for (size_t i = 0; i < players.size(); i++) {
+		cues.push_back(vector<Player::Cue>());
+		for (auto& cue : players[i]->get_cues()) {
+			if ((cue.period == 0) || ((cue.period & (cue.period - 1)) != 0) || (cue.period > WHEEL_MAX_SLOTS) || (cue.phase >= cue.period)) {
+				fprintf(stderr, "Player %lu has bad cue (period %lu, phase %lu), ignoring it.\n", i, cue.period, cue.phase);
+				continue;
+			}
+			cues[i].push_back(cue);
+			n_slots = max(n_slots, cue.period);
+		}
+	}
+	this->wheel = vector<vector<size_t>>(n_slots);
+	this->wheel_mask = n_slots - 1;
+	for (size_t i = 0; i < players.size(); i++) {
+		for (auto& cue : cues[i]) {
+			for (size_t slot = cue.phase; slot < n_slots; slot += cue.period) {
+				if (this->wheel[slot].empty() || (this->wheel[slot].back() != i)) {
+					this->wheel[slot].push_back(i);
+				}
+			}
+		}
 	}
 
-	this->add_player<Drummer>();
-	this->add_player<Flutist>();
-	this->add_player<Pianist>();
-	this->add_player<Singer>();
+	// Soundfonts no program is from are not loaded at all
+	vector<bool> needed(this->soundfont_paths.size(), false);
+	for (size_t i = 0; i < players.size(); i++) {
+		this->player_synths.push_back(i % this->synths.size());
+		this->programs.push_back(vector<Player::Program>());
+		for (auto& program : players[i]->get_programs()) {
+			if (program.sf >= needed.size()) {
+				fprintf(stderr, "Player %lu has program from unknown soundfont %lu, ignoring it.\n", i, program.sf);
+				continue;
+			}
+			if ((program.chan < 0) || (program.chan >= MIDI_CHANNELS)) {
+				fprintf(stderr, "Player %lu has program at channel %d, past %d channels of synth, ignoring it.\n", i, program.chan, MIDI_CHANNELS);
+				continue;
+			}
+			this->programs[i].push_back(program);
+			this->chan_synths[program.chan] = this->player_synths[i];
+			needed[program.sf] = true;
+		}
+	}
+	vector<string> paths;
+	for (size_t i_sf = 0; i_sf < needed.size(); i_sf++) {
+		if (needed[i_sf]) {
+			this->soundfonts_loaded.push_back(i_sf);
+			paths.push_back(this->soundfont_paths[i_sf]);
+		} else {
+			this->soundfonts_settled[i_sf] = true;
+		}
+	}
+	this->bring_online(); // those needing no soundfont
+	this->sfloader->start(paths, [this](size_t i_load, const string& path) {
+		return this->install_soundfont(i_load, path);
+	});
+}
 
-	this->eventogram = vector<uint8_t>(cfg::WIDTH * this->players.size() * 3);
+int Ensemble::install_soundfont(size_t i_load, const string& path) {
+	auto sfid = fluid_synth_sfload(this->loading_synth, path.c_str(), 0);
+	auto i_sf = this->soundfonts_loaded[i_load];
+	this->loading_sfids[i_sf] = sfid;
+	auto sfont = (sfid != FLUID_FAILED) ? fluid_synth_get_sfont_by_id(this->loading_synth, sfid) : NULL;
+	for (size_t j = 0; j < this->synths.size(); j++) {
+		this->sfids[j][i_sf] = (sfont != NULL) ? fluid_synth_add_sfont(this->synths[j], sfont) : FLUID_FAILED; // shared, not copied
+	}
+	this->soundfonts_settled[i_sf] = true;
+	this->bring_online();
+	return sfid;
 }
 
-void Ensemble::react_and_read(vector<uint8_t>& spectrogram, size_t i_blk, int16_t* output) {
-	SpectrumStats spectrum_stats{0, -1.0, 0.0};
+void Ensemble::bring_online() {
+	auto online = this->online.load(memory_order_relaxed);
+	for (size_t i = 0; i < this->programs.size(); i++) {
+		if ((online & (uint64_t(1) << i)) != 0) {
+			continue;
+		}
+		bool settled = true;
+		for (auto& program : this->programs[i]) {
+			settled = settled && this->soundfonts_settled[program.sf];
+		}
+		if (settled) {
+			// Samples of presets are loaded here, so that only these are resident: by loading synth, then rendered one takes them
+			for (auto& program : this->programs[i]) {
+				auto j = this->player_synths[i];
+				fluid_synth_program_select(this->loading_synth, program.chan, this->loading_sfids[program.sf], program.bank, program.num);
+				fluid_synth_program_select(this->synths[j], program.chan, this->sfids[j][program.sf], program.bank, program.num);
+			}
+			online |= uint64_t(1) << i;
+		}
+	}
+	this->online.store(online, memory_order_release);
+}
 
-	auto spc = this->sliding_averfade_spectrum.data();
-	auto spg = spectrogram.data() + i_blk * (cfg::BANDWIDTH * cfg::CHANNELS);
-	for (size_t i = 0; i < cfg::BANDWIDTH; i++) {	
-		*spc = uint8_t(cfg::AVERFADE_WEIGHT * (*spc) + (1.0 - cfg::AVERFADE_WEIGHT) * 0.5 * ((*spg) + (*(spg + 1))));
+template<size_t BS, size_t CH, bool PL>
+void Ensemble::Averfade::run(uint8_t* spc, const uint8_t* spg, Features& features) {
+	const size_t bandwidth = fast_blocksize<BS>() >> 1;
+	const size_t stride = fast_stride<CH, PL>();
+	const size_t last = (fast_channels<CH>() - 1) * fast_bins_lane<BS, PL>();
+	for (size_t i = 0; i < bandwidth; i++) {	
+		*spc = uint8_t(cfg::AVERFADE_WEIGHT * (*spc) + (1.0 - cfg::AVERFADE_WEIGHT) * 0.5 * ((*spg) + (*(spg + last))));
 		
-		spectrum_stats.mean += *spc;
-		if (*spc > spectrum_stats.max) {
-			spectrum_stats.max = *spc;
-			spectrum_stats.argmax = i;
+		features.mean += *spc;
+		if (*spc > features.max) {
+			features.max = *spc;
+			features.argmax = i;
 		}
 		
 		spc++;
-		spg += cfg::CHANNELS;
+		spg += stride;
+	}
+	features.mean /= bandwidth;
+}
+
+void Ensemble::react_and_read(const uint8_t* spectrogram, size_t i_blk, int16_t* output) {
+	auto t = (this->timings != NULL) ? Timings::now() : 0;
+
+	this->features.argmax = 0;
+	this->features.max = -1.0;
+	this->features.mean = 0.0;
+	auto pos_blk = this->pos_blk.load(memory_order_relaxed);
+
+	this->sliding_averfade_spectrum_lock.write_begin();
+	this->averfade_fn(this->sliding_averfade_spectrum.data(), spectrogram + i_blk * (cfg::BANDWIDTH * cfg::CHANNELS), this->features);
+	this->sliding_averfade_spectrum_lock.write_end();
+	this->feature_extractor.extract(spectrogram + i_blk * (cfg::BANDWIDTH * cfg::CHANNELS), this->features);
+
+	if (this->timings != NULL) {
+		t = this->timings->lap(Timings::FEATURES, t);
 	}
-	spectrum_stats.mean /= cfg::BANDWIDTH;
 	
-	auto evg = this->eventogram.data() + (this->pos_blk * this->players.size() * 3);
-	for (size_t i = 0; i < this->players.size(); i++) {
-		auto r = this->players[i]->react(this->synth, spectrogram, i_blk, spectrum_stats);
-		*evg = get<0>(r);
-		evg++;
-		*evg = get<1>(r);
-		evg++;
-		*evg = get<2>(r);
-		evg++;
+	// Only due players react (of those online), others have no events
+	auto evg_column = this->eventogram.data() + (pos_blk * this->n_players * 3);
+	this->eventogram_locks[pos_blk].write_begin();
+	memset(evg_column, 0, this->n_players * 3);
+	for (auto& out : this->outs) {
+		out.log = this->midilog;
+		out.i_blk = this->n_blk;
+	}
+	if (this->governor != NULL) {
+		this->govern();
+	}
+	if (this->replay != NULL) {
+		this->replay_block(); // its programs are logged as replayed
+	} else {
+		if (this->midilog != NULL) {
+			this->log_programs();
+		}
+		this->react_players(i_blk, this->features, evg_column, t);
+	}
+	this->eventogram_locks[pos_blk].write_end();
+
+	this->render_output = output;
+	if (this->render_workers) {
+		this->render_workers->run(this->render_fn);
+		for (size_t j = 1; j < this->synths.size(); j++) {
+			kernels::add(output, this->synth_blocks[j].data(), cfg::BLOCKSIZE * cfg::CHANNELS);
+		}
+	} else {
+		this->render_fn(0);
+	}
+
+	if (this->timings != NULL) {
+		this->timings->lap(Timings::SYNTH_RENDER, t);
 	}
 
-	fluid_synth_write_s16(this->synth, cfg::BLOCKSIZE, output, 0, cfg::CHANNELS, output, 1, cfg::CHANNELS);
+	// Update slice of synth spectrogram, asynchronously
+	if ((this->analyzer != NULL) && ((this->governor == NULL) || (this->governor->get_level() < Governor::NO_SYNTH_ANALYSIS))) {
+		this->analyzer->submit(output, this->spectrogram.data() + pos_blk * (cfg::BANDWIDTH * cfg::CHANNELS), &(this->spectrogram_locks[pos_blk]), Timings::SYNTH_ANALYSIS);
+	}
 
-	// Update slice of synth spectrogram
-	double scale = 1.0 / 32768.0;
-	double re, im, lum;
-	for (size_t c = 0; c < cfg::CHANNELS; c++) {
-		auto src = output + c;
-		auto blk = this->block1d.data();
+	this->n_blk++;
+	this->pos_blk.store((pos_blk + 1) % cfg::WIDTH, memory_order_release);
+}
+
+void Ensemble::write_synth(fluid_synth_t* synth, int16_t* block, int16_t* right) {
+	if (cfg::CHANNELS == 1) {
+		fluid_synth_write_s16(synth, cfg::BLOCKSIZE, block, 0, 1, right, 0, 1);
 		for (size_t i = 0; i < cfg::BLOCKSIZE; i++) {
-			*blk = double(*src) * scale;
-			blk++;
-			src += cfg::CHANNELS;
-		}
-		cv::dft(this->block1d, this->spectrum);
-		auto spc = this->spectrum.data() + 1; // skip "freq 0"
-		auto spg = this->spectrogram.data() + (this->pos_blk * cfg::BANDWIDTH * cfg::CHANNELS) + c;
-		for (size_t i = 0; i < cfg::BANDWIDTH; i++) {
-			re = *spc;
-			im = ((i + 1) < cfg::BANDWIDTH) ? *(spc + 1) : 0.0;
-			lum = (8 + log10(1e-8 + re * re + im * im)) / 12;
-			if (lum > 1.0) {
-				lum = 1.0;
+			block[i] = int16_t((int32_t(block[i]) + right[i]) >> 1);
+		}
+	} else {
+		if (cfg::CHANNELS > 2) {
+			memset(block, 0, cfg::BLOCKMEMSIZE); // other channels are silent, not left from previous block
+		}
+		fluid_synth_write_s16(synth, cfg::BLOCKSIZE, block, 0, cfg::STRIDE, block, cfg::SAMPLES_LANE, cfg::STRIDE);
+	}
+}
+
+void Ensemble::govern() {
+	auto level = int(this->governor->get_level());
+	if (level == this->governed_level) {
+		return;
+	}
+	bool low_polyphony = (level >= Governor::LOW_POLYPHONY);
+	if (low_polyphony != (this->governed_level >= Governor::LOW_POLYPHONY)) {
+		for (auto synth : this->synths) {
+			fluid_synth_set_polyphony(synth, low_polyphony ? int(cfg::GOVERNOR_POLYPHONY) : this->polyphony);
+		}
+	}
+	bool no_effects = (level >= Governor::NO_EFFECTS);
+	if (no_effects != (this->governed_level >= Governor::NO_EFFECTS)) {
+		for (auto synth : this->synths) {
+			fluid_synth_reverb_on(synth, -1, no_effects ? 0 : 1);
+			fluid_synth_chorus_on(synth, -1, no_effects ? 0 : 1);
+		}
+	}
+	this->governed_level = level;
+}
+
+void Ensemble::log_programs() {
+	auto online = this->online.load(memory_order_acquire);
+	if (online == this->logged_online) {
+		return;
+	}
+	for (size_t i = 0; i < this->programs.size(); i++) {
+		if (((online & ~(this->logged_online)) & (uint64_t(1) << i)) != 0) {
+			for (auto& program : this->programs[i]) {
+				this->outs[this->player_synths[i]].record_program(program.chan, program.sf, program.bank, program.num);
 			}
-			*spg = uint8_t(0xFF * lum);
-			spc += 2;
-			spg += cfg::CHANNELS;
 		}
 	}
+	this->logged_online = online;
+}
 
-	this->pos_blk = (this->pos_blk + 1) % cfg::WIDTH;
+void Ensemble::replay_block() {
+	auto& events = *(this->replay);
+	while ((this->replay_pos < events.size()) && (events[this->replay_pos].i_blk <= this->n_blk)) {
+		auto& event = events[this->replay_pos];
+		auto j = this->chan_synths[event.chan];
+		auto& out = this->outs[j];
+		switch (event.type) {
+			case MidiLog::Event::NOTE_ON:
+				out.noteon(event.chan, event.data[0], event.data[1]);
+				break;
+			case MidiLog::Event::NOTE_OFF:
+				out.noteoff(event.chan, event.data[0]);
+				break;
+			case MidiLog::Event::CC:
+				out.cc(event.chan, event.data[0], event.data[1]);
+				break;
+			case MidiLog::Event::PROGRAM:
+				if ((event.data[0] >= 0) && (size_t(event.data[0]) < this->sfids[j].size())) {
+					fluid_synth_program_select(this->synths[j], event.chan, this->sfids[j][event.data[0]], event.data[1], event.data[2]);
+				}
+				out.record_program(event.chan, event.data[0], event.data[1], event.data[2]);
+				break;
+		}
+		this->replay_pos++;
+	}
 }
 
 size_t Ensemble::get_sfids_num() {
-	return this->sfids.size();
+	return this->soundfonts_loaded.size();
 }
 
 size_t Ensemble::get_players_num() {
-	return this->players.size();
+	return this->n_players;
+}
+
+void Ensemble::wait_soundfonts() {
+	this->sfloader->wait();
+}
+
+void Ensemble::report_soundfonts(FILE* f) {
+	this->sfloader->report(f);
+}
+
+void* Ensemble::operator new(size_t size) {
+	void* ptr;
+	if (posix_memalign(&ptr, alignof(Features), size) != 0) {
+		throw bad_alloc();
+	}
+	return ptr;
+}
+
+void Ensemble::operator delete(void* ptr) {
+	free(ptr);
 }
 
 Ensemble::~Ensemble() {
-	delete_fluid_synth(this->synth);
+	this->sfloader.reset(); // waits for loads
+	this->render_workers.reset();
+	// Shared soundfonts belong to loading synth, so rendered ones give them back first
+	for (size_t j = 0; j < this->synths.size(); j++) {
+		for (auto sfid : this->sfids[j]) {
+			auto sfont = (sfid != FLUID_FAILED) ? fluid_synth_get_sfont_by_id(this->synths[j], sfid) : NULL;
+			if (sfont != NULL) {
+				fluid_synth_remove_sfont(this->synths[j], sfont);
+			}
+		}
+		delete_fluid_synth(this->synths[j]);
+	}
+	delete_fluid_synth(this->loading_synth);
 	delete_fluid_settings(this->fls_settings);
 }
+
+DynamicEnsemble::DynamicEnsemble(const vector<string>& names) {
+	for (auto& name : names) {
+		auto new_channel = this->new_channel;
+		if (this->players.size() == MAX_PLAYERS) {
+			fprintf(stderr, "More than %lu players, skipping \"%s\".\n", MAX_PLAYERS, name.c_str());
+		} else if (name == PLAYER_NAMES[0]) {
+			this->add_player<Drummer>();
+		} else if (name == PLAYER_NAMES[1]) {
+			this->add_player<Flutist>();
+		} else if (name == PLAYER_NAMES[2]) {
+			this->add_player<Pianist>();
+		} else if (name == PLAYER_NAMES[3]) {
+			this->add_player<Singer>();
+		} else {
+			fprintf(stderr, "Unknown player \"%s\", skipping it.\n", name.c_str());
+		}
+		if (this->new_channel > MIDI_CHANNELS) {
+			fprintf(stderr, "More than %d channels of synth taken, skipping \"%s\".\n", MIDI_CHANNELS, name.c_str());
+			this->players.pop_back();
+			this->new_channel = new_channel;
+		}
+	}
+	vector<Player*> players;
+	for (auto& player : this->players) {
+		players.push_back(player.get());
+	}
+	this->init_players(players);
+}
+
+DynamicEnsemble::~DynamicEnsemble() {
+	this->wait_soundfonts();
+}
+
+void DynamicEnsemble::react_players(size_t i_blk, const Features& features, uint8_t* evg_column, int64_t& t) {
+	auto online = this->online.load(memory_order_acquire);
+	for (auto i : this->wheel[i_blk & this->wheel_mask]) {
+		if ((online & (uint64_t(1) << i)) == 0) {
+			continue;
+		}
+		auto r = this->players[i]->react(this->outs[this->player_synths[i]], i_blk, features);
+		auto evg = evg_column + i * 3;
+		*evg = get<0>(r);
+		evg++;
+		*evg = get<1>(r);
+		evg++;
+		*evg = get<2>(r);
+		if (this->timings != NULL) {
+			t = this->timings->lap(Timings::PLAYERS + i, t);
+		}
+	}
+}
@@ -3,40 +3,227 @@
 
 #include <fluidsynth.h>
 
+#include <atomic>
+#include <functional>
+#include <string>
+#include <tuple>
 #include <vector>
 
+#include "analyzer.hpp"
+#include "features.hpp"
+#include "forkjoin.hpp"
+#include "governor.hpp"
+#include "midilog.hpp"
+#include "players/drummer.hpp"
+#include "players/flutist.hpp"
+#include "players/pianist.hpp"
 #include "players/player.hpp"
+#include "players/singer.hpp"
+#include "seqlock.hpp"
+#include "sfloader.hpp"
+#include "timings.hpp"
 
 using namespace std;
 
+// Synth, soundfonts, and per-block processing around players, whose line-up is kept by derived class:
+// DynamicEnsemble composed at runtime, or StaticEnsemble fixed at compile time
 class Ensemble {
 
 	fluid_settings_t* fls_settings;
-	fluid_synth_t* synth;
+
+	// Updates sliding fading-average spectrum by mean of 1st & last channels of spectrogram slice, and its stats in features
+	struct Averfade {
+		template<size_t BS, size_t CH, bool PL>
+		static void run(uint8_t* spc, const uint8_t* spg, Features& features);
+	};
+
+	void (*averfade_fn)(uint8_t* spc, const uint8_t* spg, Features& features);
+
+	FeatureExtractor feature_extractor;
+	Features features; // of the block under reading head, for all players
+
+	// Soundfonts are loaded in background by synth which is not rendered, so the sound thread never waits for its lock,
+	// and added to rendered synths, shared; samples of programs are loaded by selecting them in it first, so that
+	// rendered synths only take them when player comes online. Players already online keep playing meanwhile
+	fluid_synth_t* loading_synth;
+	vector<int> loading_sfids; // by SFIDS, FLUID_FAILED until loaded
+	unique_ptr<SoundfontLoader> sfloader;
+	vector<string> soundfont_paths;
+	vector<size_t> soundfonts_loaded; // SFIDS by index of load, only of those some program is from
+	vector<bool> soundfonts_settled; // loaded or failed (or not needed), by installer only
+	vector<vector<Player::Program>> programs; // of each player
+
+	int install_soundfont(size_t i_load, const string& path); // on loader's thread
+	void bring_online(); // selects programs of players whose soundfonts are settled
+
+	// Of sound thread
+	uint64_t n_blk = 0; // rendered since start
+	uint64_t logged_online = 0; // players whose programs are in log
+	size_t replay_pos = 0; // next event to replay
+
+	void log_programs(); // of players come online since previous call
+	void replay_block(); // events of blocks up to the current one
+
+	int polyphony; // of synths, when not lowered
+	int governed_level = Governor::FULL; // applied to synths
+	void govern(); // applies level of governor to synths, when it has changed
+
+	// Synths are rendered in parallel, the 1st one to output by the sound thread, others to own blocks by workers,
+	// which are then added to output
+	unique_ptr<ForkJoin> render_workers;
+	vector<vector<int16_t>> synth_blocks;
+	vector<vector<int16_t>> synth_rights; // of each synth, right channel to be mixed into mono
+	int16_t* render_output = NULL;
+	function<void(size_t)> render_fn;
+
+protected:
+
+	fluid_synth_t* synth; // the 1st of synths
+	vector<fluid_synth_t*> synths; // cfg::SYNTHS
+	vector<MidiOut> outs; // to each synth
+	vector<size_t> player_synths; // synth of each player, round-robin
+	vector<size_t> chan_synths; // synth of each channel, 0 if unused
 	int new_channel;
-	vector<int> sfids;
-	vector<unique_ptr<Player>> players;
-	vector<double> block1d; // to avoid allocations in callback
-	vector<double> spectrum; // to avoid allocations in callback
+	vector<vector<int>> sfids; // of each synth, by SFIDS, FLUID_FAILED until loaded
+	size_t n_players;
 
-	template<class P>
-	void add_player();
+	static const size_t MAX_PLAYERS = 64;
+	static const int MIDI_CHANNELS = 0x100; // of each synth, FluidSynth's maximum, taken by players in turn (a few each)
+	atomic<uint64_t> online; // bit i is set once player i has its programs selected, then it may react
+
+	// Timing wheel of players' cues: slot i_blk % wheel size lists players due at i_blk, in order of line-up
+	static const size_t WHEEL_MAX_SLOTS = 0x10000;
+	vector<vector<size_t>> wheel;
+	size_t wheel_mask;
+
+	// To be called by derived constructor, once players are there; starts loading of soundfonts.
+	// Derived destructor must wait_soundfonts() before players are gone
+	void init_players(const vector<Player*>& players);
+
+	// Due players react to features of block i_blk, each writing its events to evg_column + 3 * (its index),
+	// and lapping its timings stage from t; others' events are zeroed already
+	virtual void react_players(size_t i_blk, const Features& features, uint8_t* evg_column, int64_t& t) = 0;
 
 public:
-	
-	size_t pos_blk;
+
+	atomic<size_t> pos_blk; // advanced by the thread of sound output only (released), read by others (acquired)
 	vector<uint8_t> sliding_averfade_spectrum;
 	vector<uint8_t> spectrogram;
 	vector<uint8_t> eventogram;
+	// For tear-free copies by UI: the whole spectrum, and per column of the others
+	SeqLock sliding_averfade_spectrum_lock;
+	unique_ptr<SeqLock[]> spectrogram_locks;
+	unique_ptr<SeqLock[]> eventogram_locks;
+	Timings* timings = NULL;
+	Analyzer* analyzer = NULL; // fills spectrogram, if set
+	MidiLog* midilog = NULL; // records events sent to synth, if set
+	Governor* governor = NULL; // sheds synth analysis, voices, and effects, if set
+	const vector<MidiLog::Event>* replay = NULL; // drives synth instead of players, if set
 
 	Ensemble();
 
-	void react_and_read(vector<uint8_t>& spectrogram, size_t i_blk, int16_t* output);
-	size_t get_sfids_num();
+	void react_and_read(const uint8_t* spectrogram, size_t i_blk, int16_t* output);
+
+	// BLOCKSIZE frames of synth to block of cfg layout: left to 1st channel, right to 2nd one, others are zeroed;
+	// mono gets their mean, right going to right (BLOCKSIZE samples) first
+	static void write_synth(fluid_synth_t* synth, int16_t* block, int16_t* right);
+	void wait_soundfonts(); // until all are loaded or failed, and players are online
+	void report_soundfonts(FILE* f); // timeline of loads finished since previous call
+	size_t get_sfids_num(); // of soundfonts players need, being loaded
 	size_t get_players_num();
-	
-	~Ensemble();
+
+	// Heap instances are aligned for features too, which new of C++11 does not care about
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr);
+
+	virtual ~Ensemble();
 
 };
 
+// Players composed at runtime, e.g. by names, each called through virtual react()
+class DynamicEnsemble : public Ensemble {
+
+	vector<unique_ptr<Player>> players;
+
+	template<class P>
+	void add_player();
+
+	void react_players(size_t i_blk, const Features& features, uint8_t* evg_column, int64_t& t);
+
+public:
+
+	static const char* const PLAYER_NAMES[];
+
+	DynamicEnsemble(const vector<string>& names); // of PLAYER_NAMES, unknown ones and those above MAX_PLAYERS or MIDI_CHANNELS are skipped with a warning
+	~DynamicEnsemble();
+
+};
+
+// Players of types Ps, stored inline and called directly, with dispatch by the wheel unrolled at compile time
+template<class... Ps>
+class StaticEnsemble : public Ensemble {
+
+	static_assert(sizeof...(Ps) <= Ensemble::MAX_PLAYERS, "wheel masks are 64-bit");
+
+	tuple<Ps...> players;
+	vector<uint64_t> wheel_masks; // bit i of slot is set if player i is due
+
+	template<size_t I>
+	inline typename enable_if<(I < sizeof...(Ps))>::type react_from(uint64_t mask, size_t i_blk, const Features& features, uint8_t* evg_column, int64_t& t) {
+		if (mask & (uint64_t(1) << I)) {
+			typedef typename tuple_element<I, tuple<Ps...>>::type P;
+			auto r = get<I>(this->players).P::react(this->outs[this->player_synths[I]], i_blk, features); // not virtual
+			auto evg = evg_column + I * 3;
+			evg[0] = get<0>(r);
+			evg[1] = get<1>(r);
+			evg[2] = get<2>(r);
+			if (this->timings != NULL) {
+				t = this->timings->lap(Timings::PLAYERS + I, t);
+			}
+		}
+		this->react_from<I + 1>(mask, i_blk, features, evg_column, t);
+	}
+
+	template<size_t I>
+	inline typename enable_if<(I == sizeof...(Ps))>::type react_from(uint64_t mask, size_t i_blk, const Features& features, uint8_t* evg_column, int64_t& t) {
+	}
+
+	void react_players(size_t i_blk, const Features& features, uint8_t* evg_column, int64_t& t) {
+		this->react_from<0>(this->wheel_masks[i_blk & this->wheel_mask] & this->online.load(memory_order_acquire), i_blk, features, evg_column, t);
+	}
+
+	template<size_t I>
+	typename enable_if<(I < sizeof...(Ps))>::type collect(vector<Player*>& players) {
+		players.push_back(&get<I>(this->players));
+		this->collect<I + 1>(players);
+	}
+
+	template<size_t I>
+	typename enable_if<(I == sizeof...(Ps))>::type collect(vector<Player*>& players) {
+	}
+
+public:
+
+	// Braced list constructs players left to right, so they take synth channels in order of Ps
+	StaticEnsemble() : players{Ps(this->new_channel)...} {
+		vector<Player*> players;
+		this->collect<0>(players);
+		this->init_players(players);
+		this->wheel_masks = vector<uint64_t>(this->wheel.size(), 0);
+		for (size_t slot = 0; slot < this->wheel.size(); slot++) {
+			for (auto i : this->wheel[slot]) {
+				this->wheel_masks[slot] |= uint64_t(1) << i;
+			}
+		}
+	}
+
+	~StaticEnsemble() {
+		this->wait_soundfonts();
+	}
+
+};
+
+typedef StaticEnsemble<Drummer, Flutist, Pianist, Singer> DefaultEnsemble;
+extern template class StaticEnsemble<Drummer, Flutist, Pianist, Singer>;
+
 #endif
\ No newline at end of file
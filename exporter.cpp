@@ -0,0 +1,154 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "exporter.hpp"
+
+Exporter::Exporter(Format format, const string& path, size_t width, size_t height) : frames(QUEUE_FRAMES, vector<uint8_t>((width * height) << 2)) {
+	this->format = format;
+	this->path = path;
+	this->width = width;
+	this->height = height;
+	this->n_exported.store(0);
+	this->n_dropped.store(0);
+	this->stopping.store(false);
+	if (this->format == PNG) {
+		this->png_image = cv::Mat(height, width, CV_8UC3);
+	} else {
+		this->raw_frame = vector<uint8_t>((width * height) << 2);
+		signal(SIGPIPE, SIG_IGN); // if encoder quits, fwrite() just fails
+	}
+	sem_init(&(this->sem), 0, 0);
+	this->worker = thread(&Exporter::work, this);
+}
+
+void Exporter::push(const cv::Mat& frame) {
+	auto slot = this->frames.claim();
+	if (slot == NULL) {
+		this->n_dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	memcpy(slot->data(), frame.data, slot->size());
+	this->frames.publish();
+	sem_post(&(this->sem));
+}
+
+// Frame is BGRA with alpha 0, as drawn by Renderer
+void Exporter::encode(const uint8_t* frame) {
+	if (this->format == PNG) {
+		if (this->n_exported.load(memory_order_relaxed) == 0) {
+			if ((mkdir(this->path.c_str(), 0755) != 0) && (errno != EEXIST)) {
+				fprintf(stderr, "Cannot create \"%s\" dir of exported frames: %s.\n", this->path.c_str(), strerror(errno));
+				this->failed = true;
+				return;
+			}
+		}
+		auto pixel = this->png_image.data;
+		for (size_t i = 0; i < this->width * this->height; i++) {
+			pixel[0] = frame[0];
+			pixel[1] = frame[1];
+			pixel[2] = frame[2];
+			pixel += 3;
+			frame += 4;
+		}
+		char name[0x20];
+		snprintf(name, sizeof(name), "/%06lu.png", this->n_exported.load(memory_order_relaxed));
+		if (!cv::imwrite(this->path + name, this->png_image)) {
+			fprintf(stderr, "Cannot write \"%s%s\" exported frame.\n", this->path.c_str(), name);
+			this->failed = true;
+			return;
+		}
+	} else {
+		if (this->raw_file == NULL) {
+			this->raw_file = fopen(this->path.c_str(), "wb"); // named pipe blocks here until encoder opens it, frames are dropped meanwhile
+			if (this->raw_file == NULL) {
+				fprintf(stderr, "Cannot open \"%s\" for exported frames: %s.\n", this->path.c_str(), strerror(errno));
+				this->failed = true;
+				return;
+			}
+		}
+		auto pixel = this->raw_frame.data();
+		for (size_t i = 0; i < this->width * this->height; i++) {
+			pixel[0] = frame[2];
+			pixel[1] = frame[1];
+			pixel[2] = frame[0];
+			pixel[3] = 0xFF;
+			pixel += 4;
+			frame += 4;
+		}
+		if (fwrite(this->raw_frame.data(), this->raw_frame.size(), 1, this->raw_file) != 1) {
+			fprintf(stderr, "Cannot write exported frame to \"%s\": %s.\n", this->path.c_str(), strerror(errno)); // e.g. encoder has quit
+			this->failed = true;
+			return;
+		}
+	}
+	this->n_exported.store(this->n_exported.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void Exporter::drain() {
+	vector<uint8_t>* frame;
+	while ((frame = this->frames.peek()) != NULL) {
+		if (this->failed) {
+			this->n_dropped.fetch_add(1, memory_order_relaxed);
+		} else {
+			this->encode(frame->data());
+		}
+		this->frames.release();
+	}
+}
+
+void Exporter::work() {
+	while (true) {
+		while ((sem_wait(&(this->sem)) != 0) && (errno == EINTR)) {
+		}
+		if (this->stopping.load(memory_order_acquire)) {
+			break;
+		}
+		this->drain();
+	}
+	this->drain();
+	if (this->raw_file != NULL) {
+		fclose(this->raw_file);
+		this->raw_file = NULL;
+	}
+}
+
+void Exporter::stop() {
+	if (this->worker.joinable()) {
+		this->stopping.store(true, memory_order_release);
+		sem_post(&(this->sem));
+		this->worker.join();
+		sem_destroy(&(this->sem));
+	}
+}
+
+Exporter::~Exporter() {
+	this->stop();
+}
@@ -0,0 +1,67 @@
+#ifndef _EXPORTER_HPP
+#define _EXPORTER_HPP
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc.hpp"
+
+using namespace std;
+
+// Archives window frames off the UI thread: push() copies the composed image to wait-free bounded queue and posts a semaphore,
+// the worker thread encodes it, either to PNG sequence in a dir, or as raw RGBA frames to a file or named pipe of external encoder.
+// When the queue is full (disk or encoder is slow), the frame is dropped and counted, so rendering never waits for them.
+class Exporter {
+
+public:
+
+	enum Format {
+		PNG,
+		RAW
+	};
+
+private:
+
+	Format format;
+	string path;
+	size_t width;
+	size_t height;
+
+	SpscRing<vector<uint8_t>> frames;
+	sem_t sem;
+	atomic<bool> stopping;
+	thread worker;
+
+	// Of the worker
+	FILE* raw_file = NULL;
+	bool failed = false;
+	cv::Mat png_image;
+	vector<uint8_t> raw_frame;
+
+	void work();
+	void drain();
+	void encode(const uint8_t* frame);
+
+public:
+
+	static const size_t QUEUE_FRAMES = 8;
+
+	atomic<uint64_t> n_exported;
+	atomic<uint64_t> n_dropped; // frames, when queue is full or output has failed
+
+	Exporter(Format format, const string& path, size_t width, size_t height);
+
+	void push(const cv::Mat& frame); // by the only producer thread, of width x height CV_8UC4
+	void stop(); // finishes queued frames
+
+	~Exporter();
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef _FASTPATH_HPP
+#define _FASTPATH_HPP
+
+#include "config.hpp"
+
+// Hot loops over a block are written as static function templates run<BLOCKSIZE, CHANNELS, PLANAR> of some class,
+// where 0 stands for the runtime value of cfg. They are instantiated for common configurations too,
+// so that trip counts and strides there are compile-time constants, as if config was not runtime at all.
+// Layout is always a compile-time constant, so planar lanes are unit-stride.
+
+template<size_t BS>
+inline size_t fast_blocksize() {
+	return (BS != 0) ? BS : cfg::BLOCKSIZE;
+}
+
+template<size_t CH>
+inline size_t fast_channels() {
+	return (CH != 0) ? CH : cfg::CHANNELS;
+}
+
+// As cfg::STRIDE, SAMPLES_LANE, BINS_LANE
+
+template<size_t CH, bool PL>
+inline size_t fast_stride() {
+	return PL ? 1 : fast_channels<CH>();
+}
+
+template<size_t BS, bool PL>
+inline size_t fast_samples_lane() {
+	return PL ? fast_blocksize<BS>() : 1;
+}
+
+template<size_t BS, bool PL>
+inline size_t fast_bins_lane() {
+	return PL ? (fast_blocksize<BS>() >> 1) : 1;
+}
+
+template<class F, bool PL>
+auto select_fastpath_of_layout() -> decltype(&F::template run<0, 0, PL>) {
+	if (cfg::CHANNELS == 2) {
+		switch (cfg::BLOCKSIZE) {
+			case 0x100: return &F::template run<0x100, 2, PL>;
+			case 0x200: return &F::template run<0x200, 2, PL>;
+			case 0x400: return &F::template run<0x400, 2, PL>;
+		}
+	} else if (cfg::CHANNELS == 1) {
+		switch (cfg::BLOCKSIZE) {
+			case 0x100: return &F::template run<0x100, 1, PL>;
+			case 0x200: return &F::template run<0x200, 1, PL>;
+			case 0x400: return &F::template run<0x400, 1, PL>;
+		}
+	}
+	return &F::template run<0, 0, PL>;
+}
+
+// Returns F::run instantiated for current cfg, generic one (of its layout) if there is no such
+template<class F>
+auto select_fastpath() -> decltype(&F::template run<0, 0, false>) {
+	return (cfg::PLANAR != 0) ? select_fastpath_of_layout<F, true>() : select_fastpath_of_layout<F, false>();
+}
+
+inline bool is_fastpath() {
+	return ((cfg::CHANNELS == 1) || (cfg::CHANNELS == 2)) && ((cfg::BLOCKSIZE == 0x100) || (cfg::BLOCKSIZE == 0x200) || (cfg::BLOCKSIZE == 0x400));
+}
+
+#endif
\ No newline at end of file
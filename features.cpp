@@ -0,0 +1,105 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "config.hpp"
+#include "fastpath.hpp"
+#include "features.hpp"
+#include "kernels.hpp"
+
+FeatureExtractor::FeatureExtractor() {
+	this->spectrum = vector<uint8_t>(cfg::BANDWIDTH, 0);
+	this->prev_spectrum = vector<uint8_t>(cfg::BANDWIDTH, 0);
+	this->zeros = vector<uint8_t>(cfg::BANDWIDTH, 0);
+	this->band_begins[0] = 0;
+	for (size_t i = 1; i < Features::BANDS; i++) {
+		this->band_begins[i] = cfg::BANDWIDTH >> (Features::BANDS - i);
+	}
+	this->band_begins[Features::BANDS] = cfg::BANDWIDTH;
+	this->scan_fn = select_fastpath<Scan>();
+}
+
+template<size_t BS, size_t CH, bool PL>
+void FeatureExtractor::Scan::run(const uint8_t* spg, const uint8_t* zeros, uint8_t* spectrum, Features& features) {
+	const size_t bandwidth = fast_blocksize<BS>() >> 1;
+	const size_t channels = fast_channels<CH>();
+	const size_t stride = fast_stride<CH, PL>();
+	const size_t lane = fast_bins_lane<BS, PL>();
+	const size_t last = (channels - 1) * lane;
+
+	uint32_t channel_sums[Features::MAX_CHANNELS] = {0};
+	uint8_t channel_maxes[Features::MAX_CHANNELS] = {0};
+	if (stride == 1) { // planar (or mono), so lanes are reduced by kernels
+		for (size_t c = 0; c < channels; c++) {
+			channel_sums[c] = kernels::sum_excess(spg + c * lane, zeros, bandwidth);
+			channel_maxes[c] = kernels::max_of(spg + c * lane, bandwidth);
+		}
+		kernels::average(spg, spg + last, spectrum, bandwidth);
+	} else { // interleaved, so channels are split by kernel
+		kernels::scan_interleaved(spg, channels, channel_sums, channel_maxes, spectrum, bandwidth);
+	}
+	auto moment = kernels::moment(spectrum, bandwidth);
+	auto sum = kernels::sum_excess(spectrum, zeros, bandwidth);
+	for (size_t c = 0; c < Features::MAX_CHANNELS; c++) {
+		features.channel_means[c] = float(channel_sums[c]) / bandwidth;
+		features.channel_maxes[c] = channel_maxes[c];
+	}
+	features.centroid = (sum > 0) ? (float(moment) / sum) : 0.0f;
+
+	// Local maxima, highest first (and lower bin first among equal ones); scalar, as insertion of each depends on the previous ones
+	for (size_t k = 0; k < Features::PEAKS; k++) {
+		features.peaks[k] = Features::NO_PEAK;
+		features.peak_levels[k] = 0;
+	}
+	for (size_t i = 0; i < bandwidth; i++) {
+		auto s = spectrum[i];
+		if ((s == 0) || ((i > 0) && (spectrum[i - 1] >= s)) || ((i + 1 < bandwidth) && (spectrum[i + 1] > s)) || (s <= features.peak_levels[Features::PEAKS - 1])) {
+			continue;
+		}
+		auto k = Features::PEAKS - 1;
+		while ((k > 0) && (features.peak_levels[k - 1] < s)) {
+			features.peaks[k] = features.peaks[k - 1];
+			features.peak_levels[k] = features.peak_levels[k - 1];
+			k--;
+		}
+		features.peaks[k] = uint16_t(i);
+		features.peak_levels[k] = s;
+	}
+}
+
+void FeatureExtractor::extract(const uint8_t* slice, Features& features) {
+	this->scan_fn(slice, this->zeros.data(), this->spectrum.data(), features);
+
+	for (size_t i = 0; i < Features::BANDS; i++) {
+		auto n = this->band_begins[i + 1] - this->band_begins[i];
+		features.bands[i] = (n > 0) ? (float(kernels::sum_excess(this->spectrum.data() + this->band_begins[i], this->zeros.data(), n)) / n) : 0.0f;
+	}
+
+	features.flux = float(kernels::sum_excess(this->spectrum.data(), this->prev_spectrum.data(), cfg::BANDWIDTH)) / cfg::BANDWIDTH;
+	features.onset = (features.flux > ONSET_FLOOR) && (features.flux > ONSET_RATIO * this->flux_average);
+	this->flux_average = FLUX_AVERAGE_WEIGHT * this->flux_average + (1.0 - FLUX_AVERAGE_WEIGHT) * features.flux;
+
+	swap(this->spectrum, this->prev_spectrum);
+}
@@ -0,0 +1,69 @@
+#ifndef _FEATURES_HPP
+#define _FEATURES_HPP
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// Per-block features of echoes under reading head, computed once by Ensemble and read by all players.
+// Spectrum here is the mean of 1st & last channels of spectrogram slice, in luminance 0…0xFF, from the lowest frequency bin.
+// Aligned to cache line, so that the record, rewritten each block, shares its 2 lines with nothing else.
+struct alignas(64) Features {
+
+	static const size_t BANDS = 8; // octaves from the highest one down, the lowest band takes the rest of bins
+	static const size_t PEAKS = 4;
+	static const size_t MAX_CHANNELS = 8;
+	static const uint16_t NO_PEAK = 0xFFFF;
+
+	// Of sliding fading-average spectrum
+	size_t argmax;
+	double max;
+	double mean;
+
+	// Of the block's spectrum
+	float bands[BANDS]; // mean luminance per band, from the lowest one
+	float centroid; // bin, 0 if spectrum is all 0
+	float flux; // mean rise of luminance per bin since previous block
+	bool onset; // flux is well above its sliding average
+	uint16_t peaks[PEAKS]; // bins of the highest local maxima, from the highest one, NO_PEAK if there are fewer
+	uint8_t peak_levels[PEAKS];
+
+	// Of each channel's spectrum, first CHANNELS of them
+	float channel_means[MAX_CHANNELS];
+	uint8_t channel_maxes[MAX_CHANNELS];
+
+};
+
+// Fills block's features from spectrogram slice: vectorized kernels over planar lanes (interleaved ones are split by kernel),
+// then over the mean spectrum, but for peaks.
+// Keeps previous block's spectrum for flux, so is to be fed consecutive blocks by one thread.
+class FeatureExtractor {
+
+	static constexpr double FLUX_AVERAGE_WEIGHT = 0.9;
+	static constexpr double ONSET_RATIO = 2.0; // of flux to its average
+	static constexpr double ONSET_FLOOR = 1.0; // of flux
+
+	// Mean spectrum, per-channel stats, centroid, peaks
+	struct Scan {
+		template<size_t BS, size_t CH, bool PL>
+		static void run(const uint8_t* spg, const uint8_t* zeros, uint8_t* spectrum, Features& features);
+	};
+
+	void (*scan_fn)(const uint8_t* spg, const uint8_t* zeros, uint8_t* spectrum, Features& features);
+
+	vector<uint8_t> spectrum;
+	vector<uint8_t> prev_spectrum;
+	vector<uint8_t> zeros; // to sum by kernels::sum_excess()
+	size_t band_begins[Features::BANDS + 1];
+	double flux_average = 0.0;
+
+public:
+
+	FeatureExtractor();
+
+	void extract(const uint8_t* slice, Features& features); // all but those of sliding fading-average spectrum
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+
+#include "forkjoin.hpp"
+
+static inline void relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+ForkJoin::ForkJoin(size_t n_tasks) {
+	this->n_workers = n_tasks - 1;
+	this->workers = unique_ptr<Worker[]>(new Worker[this->n_workers]);
+	this->n_done.store(0);
+	this->stopping.store(false);
+	for (size_t i = 0; i < this->n_workers; i++) {
+		this->workers[i].claimed.store(true);
+		sem_init(&(this->workers[i].sem), 0, 0);
+		this->workers[i].th = thread(&ForkJoin::work, this, i + 1);
+	}
+}
+
+void ForkJoin::work(size_t i) {
+	auto& worker = this->workers[i - 1];
+	while (true) {
+		while ((sem_wait(&(worker.sem)) != 0) && (errno == EINTR)) {
+		}
+		if (this->stopping.load(memory_order_acquire)) {
+			break;
+		}
+		if (worker.claimed.exchange(true, memory_order_acq_rel)) {
+			continue; // run by submitting thread, this wake-up is late
+		}
+		(*(this->task))(i);
+		this->n_done.fetch_add(1, memory_order_release);
+	}
+}
+
+void ForkJoin::run(const function<void(size_t)>& task) {
+	this->task = &task;
+	this->n_done.store(0, memory_order_relaxed);
+	for (size_t i = 0; i < this->n_workers; i++) {
+		this->workers[i].claimed.store(false, memory_order_release); // publishes task too
+		sem_post(&(this->workers[i].sem));
+	}
+	task(0);
+	for (size_t j = 0; (j < SPINS) && (this->n_done.load(memory_order_acquire) < this->n_workers); j++) {
+		relax();
+	}
+	for (size_t i = 0; i < this->n_workers; i++) {
+		if (!this->workers[i].claimed.exchange(true, memory_order_acq_rel)) {
+			task(i + 1);
+			this->n_done.fetch_add(1, memory_order_release);
+		}
+	}
+	while (this->n_done.load(memory_order_acquire) < this->n_workers) { // the rest is running
+		relax();
+	}
+}
+
+ForkJoin::~ForkJoin() {
+	this->stopping.store(true, memory_order_release);
+	for (size_t i = 0; i < this->n_workers; i++) {
+		sem_post(&(this->workers[i].sem));
+	}
+	for (size_t i = 0; i < this->n_workers; i++) {
+		this->workers[i].th.join();
+		sem_destroy(&(this->workers[i].sem));
+	}
+}
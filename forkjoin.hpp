@@ -0,0 +1,45 @@
+#ifndef _FORKJOIN_HPP
+#define _FORKJOIN_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <semaphore.h>
+#include <thread>
+
+using namespace std;
+
+// Worker threads to split work of sound callback: task i of a batch is run by worker i, woken by its own semaphore
+// (posting does not lock), while the submitting thread runs task 0 itself, then spins briefly until workers are done.
+// Tasks whose workers have not woken by then (e.g. preempted by the scheduler) are claimed and run by the submitting thread,
+// so it waits only for tasks already running. Unlike Pool, the submitting thread never waits for a lock,
+// and batch has exactly one task per thread.
+class ForkJoin {
+
+	static const size_t SPINS = 0x400; // of waiting for workers to claim their tasks, a few microseconds each
+
+	struct Worker {
+		sem_t sem;
+		thread th;
+		atomic<bool> claimed; // task of current batch, by worker or by submitting thread
+	};
+
+	size_t n_workers;
+	unique_ptr<Worker[]> workers;
+	const function<void(size_t)>* task = NULL;
+	atomic<size_t> n_done;
+	atomic<bool> stopping;
+
+	void work(size_t i);
+
+public:
+
+	ForkJoin(size_t n_tasks); // n_tasks - 1 workers
+
+	void run(const function<void(size_t)>& task); // task(0…n_tasks-1), returns when all are done
+
+	~ForkJoin();
+
+};
+
+#endif
\ No newline at end of file
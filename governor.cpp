@@ -0,0 +1,84 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "config.hpp"
+#include "governor.hpp"
+
+static const char* LEVEL_NAMES[] = {
+	"full",
+	"no synth analysis",
+	"low polyphony",
+	"no effects",
+	"no render"
+};
+
+Governor::Governor() : transitions(QUEUE_TRANSITIONS) {
+	this->budget_ns = 1e9 * cfg::BLOCKSIZE / cfg::SAMPLERATE;
+	this->restore_windows = max(size_t(1), cfg::SAMPLERATE / (cfg::BLOCKSIZE * WINDOW_BLOCKS));
+	this->level.store(FULL);
+	this->n_transitions.store(0);
+}
+
+void Governor::transit(int to) {
+	this->transitions.push(Transition{double(this->n_blk) * cfg::BLOCKSIZE / cfg::SAMPLERATE, this->window_peak, this->level.load(memory_order_relaxed), to}); // lost if UI does not report for long, counted anyway
+	this->level.store(to, memory_order_relaxed);
+	this->n_transitions.store(this->n_transitions.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void Governor::update(uint64_t callback_ns) {
+	this->window_peak = max(this->window_peak, callback_ns / this->budget_ns);
+	this->n_blk++;
+	if ((this->n_blk % WINDOW_BLOCKS) != 0) {
+		return;
+	}
+	auto level = this->level.load(memory_order_relaxed);
+	if (this->window_peak > cfg::GOVERNOR_SHED) {
+		this->n_calm_windows = 0;
+		if (level + 1 < LEVELS_NUM) {
+			this->transit(level + 1);
+		}
+	} else if (this->window_peak < cfg::GOVERNOR_RESTORE) {
+		this->n_calm_windows++;
+		if ((this->n_calm_windows >= this->restore_windows) && (level > FULL)) {
+			this->transit(level - 1);
+			this->n_calm_windows = 0;
+		}
+	} else {
+		this->n_calm_windows = 0;
+	}
+	this->window_peak = 0.0;
+}
+
+const char* Governor::get_level_name() {
+	return LEVEL_NAMES[this->level.load(memory_order_relaxed)];
+}
+
+void Governor::report(FILE* f) {
+	Transition tr;
+	while (this->transitions.pop(tr)) {
+		fprintf(f, "\nGovernor at %.3f s, peak load %.0f %% of block: %s to \"%s\"\n", tr.t_sec, 100.0 * tr.load, (tr.to > tr.from) ? "shed" : "restored", LEVEL_NAMES[tr.to]);
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef _GOVERNOR_HPP
+#define _GOVERNOR_HPP
+
+#include <atomic>
+#include <stdio.h>
+
+#include "spsc.hpp"
+
+using namespace std;
+
+// Sheds work when sound output callback takes too much of block duration, before it misses the deadline.
+// Load is the peak share of block duration over a window of blocks: above GOVERNOR_SHED, the next level is shed,
+// and after a second of windows below GOVERNOR_RESTORE, the last shed one is restored. Levels are cumulative, in order.
+// Level is written by sound output thread only, and applied by whoever does the work; transitions are queued for report.
+class Governor {
+
+public:
+
+	enum Level {
+		FULL,
+		NO_SYNTH_ANALYSIS, // synth spectrogram is not updated
+		LOW_POLYPHONY, // to GOVERNOR_POLYPHONY
+		NO_EFFECTS, // reverb & chorus bypassed
+		NO_RENDER, // window is not redrawn
+		LEVELS_NUM
+	};
+
+	static const size_t WINDOW_BLOCKS = 0x10;
+	static const size_t QUEUE_TRANSITIONS = 0x40;
+
+	struct Transition {
+		double t_sec; // of sound, since start
+		double load;
+		int from;
+		int to;
+	};
+
+private:
+
+	double budget_ns;
+	size_t restore_windows;
+
+	// Of sound output thread
+	uint64_t n_blk = 0;
+	double window_peak = 0.0;
+	size_t n_calm_windows = 0;
+
+	atomic<int> level;
+	SpscRing<Transition> transitions;
+
+	void transit(int to);
+
+public:
+
+	atomic<uint64_t> n_transitions;
+
+	Governor();
+
+	void update(uint64_t callback_ns); // at end of each callback
+
+	Level get_level() {
+		return Level(this->level.load(memory_order_relaxed));
+	}
+
+	const char* get_level_name();
+	void report(FILE* f); // transitions since previous call
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "config.hpp"
+#include "fastpath.hpp"
+#include "interleaver.hpp"
+
+Interleaver::Interleaver() {
+	this->deinterleave_fn = select_fastpath<Deinterleave>();
+	this->interleave_fn = select_fastpath<Interleave>();
+}
+
+template<size_t BS, size_t CH, bool PL>
+void Interleaver::Deinterleave::run(const int16_t* frames, int16_t* block) {
+	const size_t blocksize = fast_blocksize<BS>();
+	const size_t channels = fast_channels<CH>();
+	if (!PL) {
+		memcpy(block, frames, blocksize * channels * sizeof(int16_t));
+		return;
+	}
+	for (size_t c = 0; c < channels; c++) {
+		auto src = frames + c;
+		for (size_t i = 0; i < blocksize; i++) {
+			block[i] = *src;
+			src += channels;
+		}
+		block += blocksize;
+	}
+}
+
+template<size_t BS, size_t CH, bool PL>
+void Interleaver::Interleave::run(const int16_t* block, int16_t* frames) {
+	const size_t blocksize = fast_blocksize<BS>();
+	const size_t channels = fast_channels<CH>();
+	if (!PL) {
+		memcpy(frames, block, blocksize * channels * sizeof(int16_t));
+		return;
+	}
+	for (size_t c = 0; c < channels; c++) {
+		auto dst = frames + c;
+		for (size_t i = 0; i < blocksize; i++) {
+			*dst = block[i];
+			dst += channels;
+		}
+		block += blocksize;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef _INTERLEAVER_HPP
+#define _INTERLEAVER_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Sound devices and files have frames of all channels one after another (interleaved), while blocks of echoes and synth
+// are of cfg layout: the same, or planar lanes of BLOCKSIZE samples of each channel one after another, if PLANAR.
+// Blocks are converted at that boundary only. Specialized for common block sizes and channels counts, see fastpath.hpp.
+class Interleaver {
+
+	struct Deinterleave {
+		template<size_t BS, size_t CH, bool PL>
+		static void run(const int16_t* frames, int16_t* block);
+	};
+
+	struct Interleave {
+		template<size_t BS, size_t CH, bool PL>
+		static void run(const int16_t* block, int16_t* frames);
+	};
+
+	void (*deinterleave_fn)(const int16_t* frames, int16_t* block);
+	void (*interleave_fn)(const int16_t* block, int16_t* frames);
+
+public:
+
+	Interleaver();
+
+	// BLOCKSIZE frames to block of cfg layout, copied as they are if it is interleaved
+	inline void deinterleave(const int16_t* frames, int16_t* block) {
+		this->deinterleave_fn(frames, block);
+	}
+
+	inline void interleave(const int16_t* block, int16_t* frames) {
+		this->interleave_fn(block, frames);
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,810 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define KERNELS_NEON
+#endif
+
+#include "config.hpp"
+#include "kernels.hpp"
+
+using namespace std;
+
+namespace kernels {
+
+// WEIGHT = 2^-weight_log2, or 0 if it is not such power of 2
+static int weight_log2 = 0;
+
+// Luminance formula rearranged as (-FLOOR_DB / 10 + lg(floor + power)) / (RANGE_DB / 10),
+// which for defaults is exactly (8 + log10(1e-8 + power)) / 12 used before; set by init(), as config is loaded by then
+static double lum_offset = 0.0;
+static double lum_scale = 1.0;
+static double floor_power = 1.0;
+
+// Table of luminance levels by bucket = (float bits of power) >> lum_shift, clamped to [lum_lo, lum_hi]:
+// level = lum_base[bucket - lum_lo] + (power >= lum_thr[bucket - lum_lo]), the latter is NaN when bucket has no threshold
+static uint32_t lum_shift = 0;
+static uint32_t lum_lo = 0;
+static uint32_t lum_hi = 0;
+static vector<int32_t> lum_base;
+static vector<float> lum_thr;
+
+// Reference
+
+static void mix_reference(int16_t* dst, const int16_t* input, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		dst[i] = int16_t(cfg::WEIGHT * input[i] + (1.0 - cfg::WEIGHT) * dst[i]);
+	}
+}
+
+static void add_reference(int16_t* dst, const int16_t* src, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		int32_t s = int32_t(dst[i]) + src[i];
+		dst[i] = int16_t((s > 0x7FFF) ? 0x7FFF : ((s < -0x8000) ? -0x8000 : s));
+	}
+}
+
+static uint32_t sum_excess_reference(const uint8_t* a, const uint8_t* b, size_t n) {
+	uint32_t sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		sum += (a[i] > b[i]) ? (a[i] - b[i]) : 0;
+	}
+	return sum;
+}
+
+static uint8_t max_of_reference(const uint8_t* a, size_t n) {
+	uint8_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		m = (a[i] > m) ? a[i] : m;
+	}
+	return m;
+}
+
+static void average_reference(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		dst[i] = uint8_t((uint32_t(a[i]) + b[i]) >> 1);
+	}
+}
+
+static void scan_interleaved_reference(const uint8_t* bins, size_t channels, uint32_t* sums, uint8_t* maxes, uint8_t* dst, size_t n) {
+	for (size_t c = 0; c < channels; c++) {
+		sums[c] = 0;
+		maxes[c] = 0;
+	}
+	for (size_t i = 0; i < n; i++) {
+		for (size_t c = 0; c < channels; c++) {
+			auto x = bins[c];
+			sums[c] += x;
+			maxes[c] = (x > maxes[c]) ? x : maxes[c];
+		}
+		dst[i] = uint8_t((uint32_t(bins[0]) + bins[channels - 1]) >> 1);
+		bins += channels;
+	}
+}
+
+// Accumulates sums & maxes of the tail, up to 4 channels, by reference
+static void scan_interleaved_tail(const uint8_t* bins, size_t channels, uint32_t* sums, uint8_t* maxes, uint8_t* dst, size_t n) {
+	uint32_t tail_sums[4];
+	uint8_t tail_maxes[4];
+	scan_interleaved_reference(bins, channels, tail_sums, tail_maxes, dst, n);
+	for (size_t c = 0; c < channels; c++) {
+		sums[c] += tail_sums[c];
+		maxes[c] = (tail_maxes[c] > maxes[c]) ? tail_maxes[c] : maxes[c];
+	}
+}
+
+static uint64_t moment_reference(const uint8_t* a, size_t n) {
+	uint64_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		m += uint64_t(i) * a[i];
+	}
+	return m;
+}
+
+// Of the tail from i, with indices of the whole
+static inline uint64_t moment_tail(const uint8_t* a, size_t i, size_t n) {
+	uint64_t m = 0;
+	for (; i < n; i++) {
+		m += uint64_t(i) * a[i];
+	}
+	return m;
+}
+
+static inline uint8_t lum_reference(float power) {
+	double lum = (lum_offset + log10(floor_power + double(power))) / lum_scale;
+	if (lum > 1.0) {
+		lum = 1.0;
+	} else if (lum < 0.0) {
+		lum = 0.0;
+	}
+	return uint8_t(0xFF * lum);
+}
+
+static void quantize_reference(const float* power, uint8_t* dst, size_t n, size_t stride) {
+	for (size_t i = 0; i < n; i++) {
+		*dst = lum_reference(power[i]);
+		dst += stride;
+	}
+}
+
+static inline uint32_t float_bits(float x) {
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return bits;
+}
+
+static inline float bits_float(uint32_t bits) {
+	float x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+static void quantize_lut(const float* power, uint8_t* dst, size_t n, size_t stride) {
+	auto base = lum_base.data();
+	auto thr = lum_thr.data();
+	for (size_t i = 0; i < n; i++) {
+		auto bucket = float_bits(power[i]) >> lum_shift;
+		bucket = (bucket < lum_lo) ? lum_lo : ((bucket > lum_hi) ? lum_hi : bucket);
+		bucket -= lum_lo;
+		*dst = uint8_t(base[bucket] + ((power[i] >= thr[bucket]) ? 1 : 0));
+		dst += stride;
+	}
+}
+
+// Positive floats are ordered as their bits, so thresholds are found by bisection over the latter
+static void init_lum_table() {
+	vector<uint32_t> thresholds(0x100); // smallest bits of power having level, for levels 1…0xFF
+	for (size_t level = 1; level < 0x100; level++) {
+		uint32_t lo = 0; // level not reached
+		uint32_t hi = float_bits(INFINITY); // reached
+		while (hi - lo > 1) {
+			uint32_t mid = lo + ((hi - lo) >> 1);
+			if (lum_reference(bits_float(mid)) >= level) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+		thresholds[level] = hi;
+	}
+
+	// Fewest mantissa bits to separate all thresholds
+	lum_shift = 23;
+	while (lum_shift > 0) {
+		bool separated = true;
+		for (size_t level = 2; level < 0x100; level++) {
+			if ((thresholds[level] >> lum_shift) == (thresholds[level - 1] >> lum_shift)) {
+				separated = false;
+				break;
+			}
+		}
+		if (separated) {
+			break;
+		}
+		lum_shift--;
+	}
+
+	// Buckets below the 1st threshold's one, and above the last's one, are of constant level
+	lum_lo = (thresholds[1] >> lum_shift) - 1;
+	lum_hi = (thresholds[0xFF] >> lum_shift) + 1;
+	lum_base = vector<int32_t>(lum_hi - lum_lo + 1);
+	lum_thr = vector<float>(lum_hi - lum_lo + 1);
+	size_t level = 0;
+	for (uint32_t bucket = lum_lo; bucket <= lum_hi; bucket++) {
+		while ((level < 0xFF) && ((thresholds[level + 1] >> lum_shift) < bucket)) {
+			level++;
+		}
+		lum_base[bucket - lum_lo] = level;
+		lum_thr[bucket - lum_lo] = ((level < 0xFF) && ((thresholds[level + 1] >> lum_shift) == bucket)) ? bits_float(thresholds[level + 1]) : NAN; // never reached, even by infinity
+	}
+}
+
+// Scalar fixed-point: (input + (2^k - 1) * dst) / 2^k, where division truncates toward 0 like int16_t(double)
+
+static inline int16_t mix_fixed_one(int16_t d, int16_t x, int k) {
+	int32_t s = int32_t(x) + (int32_t(d) << k) - d;
+	s += (s >> 31) & ((1 << k) - 1);
+	return int16_t(s >> k);
+}
+
+static void mix_scalar(int16_t* dst, const int16_t* input, size_t n) {
+	auto k = weight_log2;
+	for (size_t i = 0; i < n; i++) {
+		dst[i] = mix_fixed_one(dst[i], input[i], k);
+	}
+}
+
+#ifdef KERNELS_X86
+
+static inline __m128i mix_sse2_half(__m128i d32, __m128i x32, __m128i k, __m128i mask) {
+	auto s = _mm_sub_epi32(_mm_add_epi32(x32, _mm_sll_epi32(d32, k)), d32);
+	s = _mm_add_epi32(s, _mm_and_si128(_mm_srai_epi32(s, 31), mask));
+	return _mm_sra_epi32(s, k);
+}
+
+static void mix_sse2(int16_t* dst, const int16_t* input, size_t n) {
+	auto k = _mm_cvtsi32_si128(weight_log2);
+	auto mask = _mm_set1_epi32((1 << weight_log2) - 1);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		auto d = _mm_loadu_si128((const __m128i*)(dst + i));
+		auto x = _mm_loadu_si128((const __m128i*)(input + i));
+		// Sign-extend to 32 bits
+		auto d_lo = _mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16);
+		auto d_hi = _mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16);
+		auto x_lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		auto x_hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		auto r = _mm_packs_epi32(mix_sse2_half(d_lo, x_lo, k, mask), mix_sse2_half(d_hi, x_hi, k, mask));
+		_mm_storeu_si128((__m128i*)(dst + i), r);
+	}
+	mix_scalar(dst + i, input + i, n - i);
+}
+
+static void add_sse2(int16_t* dst, const int16_t* src, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		auto d = _mm_loadu_si128((const __m128i*)(dst + i));
+		auto s = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(d, s));
+	}
+	add_reference(dst + i, src + i, n - i);
+}
+
+// Saturated subtraction, then sums of absolute differences from 0 by 8 bytes
+static uint32_t sum_excess_sse2(const uint8_t* a, const uint8_t* b, size_t n) {
+	auto acc = _mm_setzero_si128();
+	auto zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto d = _mm_subs_epu8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(d, zero));
+	}
+	return uint32_t(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8))) + sum_excess_reference(a + i, b + i, n - i);
+}
+
+static inline uint8_t max_of_sse2_reduce(__m128i m) {
+	m = _mm_max_epu8(m, _mm_srli_si128(m, 8));
+	m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+	m = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+	m = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+	return uint8_t(_mm_cvtsi128_si32(m));
+}
+
+static uint8_t max_of_sse2(const uint8_t* a, size_t n) {
+	auto m = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		m = _mm_max_epu8(m, _mm_loadu_si128((const __m128i*)(a + i)));
+	}
+	auto m_tail = max_of_reference(a + i, n - i);
+	auto m_head = max_of_sse2_reduce(m);
+	return (m_head > m_tail) ? m_head : m_tail;
+}
+
+// Rounding-up average, less 1 where the sum is odd
+static void average_sse2(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t n) {
+	auto one = _mm_set1_epi8(1);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto x = _mm_loadu_si128((const __m128i*)(a + i));
+		auto y = _mm_loadu_si128((const __m128i*)(b + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(_mm_avg_epu8(x, y), _mm_and_si128(_mm_xor_si128(x, y), one)));
+	}
+	average_reference(a + i, b + i, dst + i, n - i);
+}
+
+// By chunks of 16: sum of k * 16 * (sum of chunk k) is 16 * ((K - 1) * total - sum of totals before each chunk),
+// and the rest, sum of j * a[16 k + j], is by multiply-adds with 0…15
+static uint64_t moment_sse2(const uint8_t* a, size_t n) {
+	auto zero = _mm_setzero_si128();
+	auto j_lo = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+	auto j_hi = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+	auto total = _mm_setzero_si128();
+	auto totals_before = _mm_setzero_si128();
+	auto within = _mm_setzero_si128(); // 32-bit, as it is 16 * 15 * 0xFF per chunk at most
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto x = _mm_loadu_si128((const __m128i*)(a + i));
+		totals_before = _mm_add_epi64(totals_before, total);
+		total = _mm_add_epi64(total, _mm_sad_epu8(x, zero));
+		within = _mm_add_epi32(within, _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(x, zero), j_lo), _mm_madd_epi16(_mm_unpackhi_epi8(x, zero), j_hi)));
+	}
+	alignas(16) uint64_t t[2];
+	alignas(16) uint64_t tb[2];
+	alignas(16) uint32_t w[4];
+	_mm_store_si128((__m128i*)t, total);
+	_mm_store_si128((__m128i*)tb, totals_before);
+	_mm_store_si128((__m128i*)w, within);
+	uint64_t n_chunks = i / 16;
+	uint64_t m = (n_chunks > 0) ? (16 * ((n_chunks - 1) * (t[0] + t[1]) - (tb[0] + tb[1]))) : 0;
+	return m + uint64_t(w[0]) + w[1] + w[2] + w[3] + moment_tail(a, i, n);
+}
+
+// Channels are split within 16-bit (or 32-bit) lanes by masks & shifts, so zero high bytes keep sums of absolute differences, maxes,
+// and floor average (a & b) + ((a ^ b) >> 1) per channel; 16 bins per step
+static void scan_interleaved_sse2(const uint8_t* bins, size_t channels, uint32_t* sums, uint8_t* maxes, uint8_t* dst, size_t n) {
+	if ((channels != 2) && (channels != 4)) {
+		scan_interleaved_reference(bins, channels, sums, maxes, dst, n);
+		return;
+	}
+	auto zero = _mm_setzero_si128();
+	__m128i acc[4] = {zero, zero, zero, zero};
+	__m128i m[4] = {zero, zero, zero, zero};
+	size_t i = 0;
+	if (channels == 2) {
+		auto mask = _mm_set1_epi16(0xFF);
+		for (; i + 16 <= n; i += 16) {
+			__m128i avgs[2];
+			for (size_t h = 0; h < 2; h++) {
+				auto x = _mm_loadu_si128((const __m128i*)(bins + 2 * i + 16 * h));
+				auto c0 = _mm_and_si128(x, mask);
+				auto c1 = _mm_srli_epi16(x, 8);
+				acc[0] = _mm_add_epi64(acc[0], _mm_sad_epu8(c0, zero));
+				acc[1] = _mm_add_epi64(acc[1], _mm_sad_epu8(c1, zero));
+				m[0] = _mm_max_epu8(m[0], c0);
+				m[1] = _mm_max_epu8(m[1], c1);
+				avgs[h] = _mm_add_epi16(_mm_and_si128(c0, c1), _mm_srli_epi16(_mm_xor_si128(c0, c1), 1));
+			}
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(avgs[0], avgs[1]));
+		}
+	} else {
+		auto mask = _mm_set1_epi32(0xFF);
+		for (; i + 16 <= n; i += 16) {
+			__m128i avgs[4];
+			for (size_t q = 0; q < 4; q++) {
+				auto x = _mm_loadu_si128((const __m128i*)(bins + 4 * i + 16 * q));
+				__m128i c[4] = {_mm_and_si128(x, mask), _mm_and_si128(_mm_srli_epi32(x, 8), mask), _mm_and_si128(_mm_srli_epi32(x, 16), mask), _mm_srli_epi32(x, 24)};
+				for (size_t k = 0; k < 4; k++) {
+					acc[k] = _mm_add_epi64(acc[k], _mm_sad_epu8(c[k], zero));
+					m[k] = _mm_max_epu8(m[k], c[k]);
+				}
+				avgs[q] = _mm_add_epi32(_mm_and_si128(c[0], c[3]), _mm_srli_epi32(_mm_xor_si128(c[0], c[3]), 1));
+			}
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_packs_epi32(avgs[0], avgs[1]), _mm_packs_epi32(avgs[2], avgs[3])));
+		}
+	}
+	for (size_t c = 0; c < channels; c++) {
+		sums[c] = uint32_t(_mm_cvtsi128_si32(acc[c]) + _mm_cvtsi128_si32(_mm_srli_si128(acc[c], 8)));
+		maxes[c] = max_of_sse2_reduce(m[c]);
+	}
+	scan_interleaved_tail(bins + channels * i, channels, sums, maxes, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mix_avx2_half(__m256i d32, __m256i x32, __m128i k, __m256i mask) {
+	auto s = _mm256_sub_epi32(_mm256_add_epi32(x32, _mm256_sll_epi32(d32, k)), d32);
+	s = _mm256_add_epi32(s, _mm256_and_si256(_mm256_srai_epi32(s, 31), mask));
+	return _mm256_sra_epi32(s, k);
+}
+
+__attribute__((target("avx2")))
+static void mix_avx2(int16_t* dst, const int16_t* input, size_t n) {
+	auto k = _mm_cvtsi32_si128(weight_log2);
+	auto mask = _mm256_set1_epi32((1 << weight_log2) - 1);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		auto x = _mm256_loadu_si256((const __m256i*)(input + i));
+		// Unpacks & pack work within 128-bit lanes, so the order is restored
+		auto d_lo = _mm256_srai_epi32(_mm256_unpacklo_epi16(d, d), 16);
+		auto d_hi = _mm256_srai_epi32(_mm256_unpackhi_epi16(d, d), 16);
+		auto x_lo = _mm256_srai_epi32(_mm256_unpacklo_epi16(x, x), 16);
+		auto x_hi = _mm256_srai_epi32(_mm256_unpackhi_epi16(x, x), 16);
+		auto r = _mm256_packs_epi32(mix_avx2_half(d_lo, x_lo, k, mask), mix_avx2_half(d_hi, x_hi, k, mask));
+		_mm256_storeu_si256((__m256i*)(dst + i), r);
+	}
+	_mm256_zeroupper(); // otherwise following SSE code, ours or of libraries, pays for transitions
+	mix_sse2(dst + i, input + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(int16_t* dst, const int16_t* src, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		auto s = _mm256_loadu_si256((const __m256i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epi16(d, s));
+	}
+	_mm256_zeroupper();
+	add_sse2(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static uint32_t sum_excess_avx2(const uint8_t* a, const uint8_t* b, size_t n) {
+	auto acc = _mm256_setzero_si256();
+	auto zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		auto d = _mm256_subs_epu8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(d, zero));
+	}
+	auto acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	return uint32_t(_mm_cvtsi128_si32(acc128) + _mm_cvtsi128_si32(_mm_srli_si128(acc128, 8))) + sum_excess_sse2(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static uint8_t max_of_avx2(const uint8_t* a, size_t n) {
+	auto m = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		m = _mm256_max_epu8(m, _mm256_loadu_si256((const __m256i*)(a + i)));
+	}
+	auto m128 = _mm_max_epu8(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+	_mm256_zeroupper();
+	auto m_head = max_of_sse2_reduce(m128);
+	auto m_tail = max_of_sse2(a + i, n - i);
+	return (m_head > m_tail) ? m_head : m_tail;
+}
+
+__attribute__((target("avx2")))
+static void average_avx2(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t n) {
+	auto one = _mm256_set1_epi8(1);
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		auto x = _mm256_loadu_si256((const __m256i*)(a + i));
+		auto y = _mm256_loadu_si256((const __m256i*)(b + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_sub_epi8(_mm256_avg_epu8(x, y), _mm256_and_si256(_mm256_xor_si256(x, y), one)));
+	}
+	_mm256_zeroupper();
+	average_sse2(a + i, b + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void quantize_avx2(const float* power, uint8_t* dst, size_t n, size_t stride) {
+	auto shift = _mm_cvtsi32_si128(lum_shift);
+	auto lo = _mm256_set1_epi32(lum_lo);
+	auto hi = _mm256_set1_epi32(lum_hi);
+	alignas(32) int32_t levels[8];
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		auto p = _mm256_loadu_ps(power + i);
+		auto bucket = _mm256_srl_epi32(_mm256_castps_si256(p), shift);
+		bucket = _mm256_sub_epi32(_mm256_min_epu32(_mm256_max_epu32(bucket, lo), hi), lo);
+		auto base = _mm256_i32gather_epi32(lum_base.data(), bucket, 4);
+		auto thr = _mm256_i32gather_ps(lum_thr.data(), bucket, 4);
+		auto reached = _mm256_castps_si256(_mm256_cmp_ps(p, thr, _CMP_GE_OQ)); // -1 or 0
+		_mm256_store_si256((__m256i*)levels, _mm256_sub_epi32(base, reached));
+		for (size_t j = 0; j < 8; j++) {
+			*dst = uint8_t(levels[j]);
+			dst += stride;
+		}
+	}
+	_mm256_zeroupper();
+	quantize_lut(power + i, dst, n - i, stride);
+}
+
+#endif
+
+#ifdef KERNELS_NEON
+
+static inline int32x4_t mix_neon_half(int32x4_t d32, int32x4_t x32, int32x4_t k, int32x4_t neg_k, int32x4_t mask) {
+	auto s = vsubq_s32(vaddq_s32(x32, vshlq_s32(d32, k)), d32);
+	s = vaddq_s32(s, vandq_s32(vshrq_n_s32(s, 31), mask));
+	return vshlq_s32(s, neg_k); // arithmetic shift right
+}
+
+static void mix_neon(int16_t* dst, const int16_t* input, size_t n) {
+	auto k = vdupq_n_s32(weight_log2);
+	auto neg_k = vdupq_n_s32(-weight_log2);
+	auto mask = vdupq_n_s32((1 << weight_log2) - 1);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		auto d = vld1q_s16(dst + i);
+		auto x = vld1q_s16(input + i);
+		auto lo = mix_neon_half(vmovl_s16(vget_low_s16(d)), vmovl_s16(vget_low_s16(x)), k, neg_k, mask);
+		auto hi = mix_neon_half(vmovl_s16(vget_high_s16(d)), vmovl_s16(vget_high_s16(x)), k, neg_k, mask);
+		vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+	mix_scalar(dst + i, input + i, n - i);
+}
+
+static void add_neon(int16_t* dst, const int16_t* src, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+	}
+	add_reference(dst + i, src + i, n - i);
+}
+
+static inline uint8_t max_of_neon_reduce(uint8x16_t m) {
+	auto m8 = vpmax_u8(vget_low_u8(m), vget_high_u8(m));
+	m8 = vpmax_u8(m8, m8);
+	m8 = vpmax_u8(m8, m8);
+	m8 = vpmax_u8(m8, m8);
+	return vget_lane_u8(m8, 0);
+}
+
+static inline uint32_t sum_neon_reduce(uint32x4_t acc) {
+	return vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) + vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+}
+
+static uint32_t sum_excess_neon(const uint8_t* a, const uint8_t* b, size_t n) {
+	auto acc = vdupq_n_u32(0);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto d = vqsubq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+		acc = vpadalq_u16(acc, vpaddlq_u8(d));
+	}
+	return sum_neon_reduce(acc) + sum_excess_reference(a + i, b + i, n - i);
+}
+
+static uint8_t max_of_neon(const uint8_t* a, size_t n) {
+	auto m = vdupq_n_u8(0);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		m = vmaxq_u8(m, vld1q_u8(a + i));
+	}
+	auto m_head = max_of_neon_reduce(m);
+	auto m_tail = max_of_reference(a + i, n - i);
+	return (m_head > m_tail) ? m_head : m_tail;
+}
+
+static void average_neon(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		vst1q_u8(dst + i, vhaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i))); // truncating
+	}
+	average_reference(a + i, b + i, dst + i, n - i);
+}
+
+// Channels are split by de-interleaving loads; 16 bins per step
+static void scan_interleaved_neon(const uint8_t* bins, size_t channels, uint32_t* sums, uint8_t* maxes, uint8_t* dst, size_t n) {
+	if ((channels != 2) && (channels != 4)) {
+		scan_interleaved_reference(bins, channels, sums, maxes, dst, n);
+		return;
+	}
+	uint32x4_t acc[4] = {vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0)};
+	uint8x16_t m[4] = {vdupq_n_u8(0), vdupq_n_u8(0), vdupq_n_u8(0), vdupq_n_u8(0)};
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t c[4];
+		if (channels == 2) {
+			auto x = vld2q_u8(bins + 2 * i);
+			c[0] = x.val[0];
+			c[1] = x.val[1];
+		} else {
+			auto x = vld4q_u8(bins + 4 * i);
+			c[0] = x.val[0];
+			c[1] = x.val[1];
+			c[2] = x.val[2];
+			c[3] = x.val[3];
+		}
+		for (size_t k = 0; k < channels; k++) {
+			acc[k] = vpadalq_u16(acc[k], vpaddlq_u8(c[k]));
+			m[k] = vmaxq_u8(m[k], c[k]);
+		}
+		vst1q_u8(dst + i, vhaddq_u8(c[0], c[channels - 1])); // truncating
+	}
+	for (size_t c = 0; c < channels; c++) {
+		sums[c] = sum_neon_reduce(acc[c]);
+		maxes[c] = max_of_neon_reduce(m[c]);
+	}
+	scan_interleaved_tail(bins + channels * i, channels, sums, maxes, dst + i, n - i);
+}
+
+// As moment_sse2(), with products of 0…15 widened by 8 bits
+static uint64_t moment_neon(const uint8_t* a, size_t n) {
+	static const uint8_t J[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+	auto j = vld1q_u8(J);
+	auto total = vdupq_n_u64(0);
+	auto totals_before = vdupq_n_u64(0);
+	auto within = vdupq_n_u32(0);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		auto x = vld1q_u8(a + i);
+		totals_before = vaddq_u64(totals_before, total);
+		total = vpadalq_u32(total, vpaddlq_u16(vpaddlq_u8(x)));
+		within = vpadalq_u16(within, vmull_u8(vget_low_u8(x), vget_low_u8(j)));
+		within = vpadalq_u16(within, vmull_u8(vget_high_u8(x), vget_high_u8(j)));
+	}
+	uint64_t n_chunks = i / 16;
+	uint64_t t = vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1);
+	uint64_t tb = vgetq_lane_u64(totals_before, 0) + vgetq_lane_u64(totals_before, 1);
+	uint64_t m = (n_chunks > 0) ? (16 * ((n_chunks - 1) * t - tb)) : 0;
+	return m + uint64_t(vgetq_lane_u32(within, 0)) + vgetq_lane_u32(within, 1) + vgetq_lane_u32(within, 2) + vgetq_lane_u32(within, 3) + moment_tail(a, i, n);
+}
+
+#endif
+
+void (*mix)(int16_t* dst, const int16_t* input, size_t n) = mix_reference;
+void (*add)(int16_t* dst, const int16_t* src, size_t n) = add_reference;
+void (*quantize)(const float* power, uint8_t* dst, size_t n, size_t stride) = quantize_reference;
+uint32_t (*sum_excess)(const uint8_t* a, const uint8_t* b, size_t n) = sum_excess_reference;
+uint8_t (*max_of)(const uint8_t* a, size_t n) = max_of_reference;
+void (*average)(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t n) = average_reference;
+uint64_t (*moment)(const uint8_t* a, size_t n) = moment_reference;
+void (*scan_interleaved)(const uint8_t* bins, size_t channels, uint32_t* sums, uint8_t* maxes, uint8_t* dst, size_t n) = scan_interleaved_reference;
+
+struct Isa {
+	const char* name;
+	bool supported;
+	void (*mix)(int16_t*, const int16_t*, size_t);
+	void (*add)(int16_t*, const int16_t*, size_t);
+	void (*quantize)(const float*, uint8_t*, size_t, size_t);
+	uint32_t (*sum_excess)(const uint8_t*, const uint8_t*, size_t);
+	uint8_t (*max_of)(const uint8_t*, size_t);
+	void (*average)(const uint8_t*, const uint8_t*, uint8_t*, size_t);
+	uint64_t (*moment)(const uint8_t*, size_t);
+	void (*scan_interleaved)(const uint8_t*, size_t, uint32_t*, uint8_t*, uint8_t*, size_t);
+};
+
+// Against reference, on pseudo-random samples mixed with extremes, and unaligned tail
+static bool verify(const Isa& isa) {
+	const size_t n = 0x1000 + 13;
+	vector<int16_t> input(n), dst(n), expected(n), actual(n);
+	uint32_t r = 12345;
+	for (size_t i = 0; i < n; i++) {
+		r = r * 1103515245 + 12345;
+		input[i] = ((i & 0xF) == 0) ? -0x8000 : (((i & 0xF) == 1) ? 0x7FFF : int16_t(r >> 16));
+		r = r * 1103515245 + 12345;
+		dst[i] = ((i & 0x1F) == 2) ? -0x8000 : (((i & 0x1F) == 3) ? 0x7FFF : int16_t(r >> 16));
+	}
+	expected = dst;
+	mix_reference(expected.data(), input.data(), n);
+	actual = dst;
+	isa.mix(actual.data(), input.data(), n);
+	if (memcmp(expected.data(), actual.data(), n * sizeof(int16_t)) != 0) {
+		return false;
+	}
+	expected = dst;
+	add_reference(expected.data(), input.data(), n);
+	actual = dst;
+	isa.add(actual.data(), input.data(), n);
+	if (memcmp(expected.data(), actual.data(), n * sizeof(int16_t)) != 0) {
+		return false;
+	}
+
+	// Bytes, at all offsets of the tail
+	vector<uint8_t> a(n), b(n);
+	for (size_t i = 0; i < n; i++) {
+		r = r * 1103515245 + 12345;
+		a[i] = ((i & 0x7) == 0) ? 0xFF : uint8_t(r >> 16);
+		b[i] = ((i & 0xF) == 1) ? 0 : uint8_t(r >> 24);
+	}
+	vector<uint8_t> expected_bytes(n), actual_bytes(n);
+	for (size_t offset = 0; offset < 0x40; offset++) {
+		auto a_o = a.data() + offset;
+		if (isa.sum_excess(a_o, b.data(), n - offset) != sum_excess_reference(a_o, b.data(), n - offset)) {
+			return false;
+		}
+		if ((isa.max_of(a_o + 8, n - offset - 8) != max_of_reference(a_o + 8, n - offset - 8)) || (isa.max_of(b.data() + offset, n - offset) != max_of_reference(b.data() + offset, n - offset))) {
+			return false;
+		}
+		if (isa.moment(a_o, n - offset) != moment_reference(a_o, n - offset)) {
+			return false;
+		}
+		average_reference(a_o, b.data(), expected_bytes.data(), n - offset);
+		isa.average(a_o, b.data(), actual_bytes.data(), n - offset);
+		if (memcmp(expected_bytes.data(), actual_bytes.data(), n - offset) != 0) {
+			return false;
+		}
+		for (size_t channels = 1; channels <= 5; channels++) {
+			auto n_bins = (n - offset) / channels;
+			uint32_t expected_sums[5], actual_sums[5];
+			uint8_t expected_maxes[5], actual_maxes[5];
+			scan_interleaved_reference(a_o, channels, expected_sums, expected_maxes, expected_bytes.data(), n_bins);
+			isa.scan_interleaved(a_o, channels, actual_sums, actual_maxes, actual_bytes.data(), n_bins);
+			if ((memcmp(expected_sums, actual_sums, channels * sizeof(uint32_t)) != 0) || (memcmp(expected_maxes, actual_maxes, channels) != 0) || (memcmp(expected_bytes.data(), actual_bytes.data(), n_bins) != 0)) {
+				return false;
+			}
+		}
+	}
+
+	// Powers at every table bucket's edges and threshold's neighbours, spread over the whole float range too
+	vector<float> powers = {0.0f, 1e-30f, 1e-12f, 1e30f, INFINITY};
+	for (uint32_t bucket = lum_lo; bucket <= lum_hi; bucket++) {
+		uint32_t bits = bucket << lum_shift;
+		powers.push_back(bits_float(bits));
+		powers.push_back(bits_float(bits - 1));
+		auto t = float_bits(lum_thr[bucket - lum_lo]);
+		if (t < float_bits(INFINITY)) {
+			powers.push_back(bits_float(t - 1));
+			powers.push_back(bits_float(t));
+			powers.push_back(bits_float(t + 1));
+		}
+	}
+	for (size_t i = 0; i < 0x1000; i++) {
+		r = r * 1103515245 + 12345;
+		powers.push_back(bits_float(r % float_bits(INFINITY)));
+	}
+	vector<uint8_t> expected_lums(powers.size()), actual_lums(powers.size());
+	quantize_reference(powers.data(), expected_lums.data(), powers.size(), 1);
+	isa.quantize(powers.data(), actual_lums.data(), powers.size(), 1);
+	return memcmp(expected_lums.data(), actual_lums.data(), powers.size()) == 0;
+}
+
+const char* init() {
+	int e;
+	double m = frexp(cfg::WEIGHT, &e); // WEIGHT = m * 2^e, 0.5 <= m < 1
+	weight_log2 = ((m == 0.5) && (e <= 0) && (e >= -14)) ? (1 - e) : 0;
+	bool fixed = weight_log2 > 0;
+
+	lum_offset = -cfg::SPECTRUM_FLOOR_DB / 10;
+	lum_scale = cfg::SPECTRUM_RANGE_DB / 10;
+	floor_power = pow(10.0, -lum_offset);
+	init_lum_table();
+
+	// From the most preferred
+	vector<Isa> isas;
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	isas.push_back(Isa{"avx2", __builtin_cpu_supports("avx2") != 0, mix_avx2, add_avx2, quantize_avx2, sum_excess_avx2, max_of_avx2, average_avx2, moment_sse2, scan_interleaved_sse2});
+	isas.push_back(Isa{"sse2", __builtin_cpu_supports("sse2") != 0, mix_sse2, add_sse2, quantize_lut, sum_excess_sse2, max_of_sse2, average_sse2, moment_sse2, scan_interleaved_sse2});
+#endif
+#ifdef KERNELS_NEON
+	isas.push_back(Isa{"neon", true, mix_neon, add_neon, quantize_lut, sum_excess_neon, max_of_neon, average_neon, moment_neon, scan_interleaved_neon});
+#endif
+	isas.push_back(Isa{"scalar", true, mix_scalar, add_reference, quantize_lut, sum_excess_reference, max_of_reference, average_reference, moment_reference, scan_interleaved_reference});
+	isas.push_back(Isa{"reference", true, mix_reference, add_reference, quantize_reference, sum_excess_reference, max_of_reference, average_reference, moment_reference, scan_interleaved_reference});
+
+	auto requested = getenv(ISA_ENVAR_NAME);
+	if ((requested != NULL) && (*requested == 0)) {
+		requested = NULL;
+	}
+	auto chosen = isas.end();
+	for (auto it = isas.begin(); it != isas.end(); it++) {
+		if (it->supported && ((requested == NULL) || (string(requested) == it->name))) {
+			chosen = it;
+			break;
+		}
+	}
+	if (chosen == isas.end()) {
+		fprintf(stderr, "\"%s\" kernels are not available, using the best ones.\n", requested);
+		for (chosen = isas.begin(); !chosen->supported; chosen++) {
+		}
+	}
+	// Only mix depends on WEIGHT, the others are of the chosen set anyway
+	auto isa = *chosen;
+	if (!fixed) {
+		isa.mix = mix_reference;
+	}
+	if (!verify(isa)) {
+		fprintf(stderr, "\"%s\" kernels differ from reference ones, using the latter.\n", isa.name);
+		isa = isas.back();
+	}
+
+	mix = isa.mix;
+	add = isa.add;
+	quantize = isa.quantize;
+	sum_excess = isa.sum_excess;
+	max_of = isa.max_of;
+	average = isa.average;
+	moment = isa.moment;
+	scan_interleaved = isa.scan_interleaved;
+	return isa.name;
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef _KERNELS_HPP
+#define _KERNELS_HPP
+
+#include <memory>
+
+// Vectorized per-sample (and per-bin) loops of sound callbacks, dispatched at runtime to the best instruction set
+// supported by CPU, or to the one named by RESONAT_KERNELS environment variable
+// ("reference", "scalar", "sse2", "avx2", "neon"). All of them are bit-exact with "reference".
+namespace kernels {
+
+const char* const ISA_ENVAR_NAME = "RESONAT_KERNELS";
+
+// dst = int16_t(WEIGHT * input + (1 - WEIGHT) * dst), truncated toward 0 as the double formula is;
+// fixed-point when WEIGHT is 2^-k, otherwise always the reference double one
+extern void (*mix)(int16_t* dst, const int16_t* input, size_t n);
+
+// dst += src, saturated
+extern void (*add)(int16_t* dst, const int16_t* src, size_t n);
+
+// dst[i * stride] = uint8_t(0xFF * lum) of power[i], lum = clamp((10 lg(floor + power) - SPECTRUM_FLOOR_DB) / SPECTRUM_RANGE_DB, 0, 1),
+// where floor = 10^(SPECTRUM_FLOOR_DB / 10). Non-reference ones use table of level thresholds, indexed by float exponent
+// and top bits of mantissa, fine enough to have at most one threshold per entry, so they give the same levels
+extern void (*quantize)(const float* power, uint8_t* dst, size_t n, size_t stride);
+
+// Sum of a[i] - b[i] over those a[i] > b[i]; of a[i], if b is zeros
+extern uint32_t (*sum_excess)(const uint8_t* a, const uint8_t* b, size_t n);
+
+// Max of a[i], 0 if n is 0
+extern uint8_t (*max_of)(const uint8_t* a, size_t n);
+
+// dst[i] = (a[i] + b[i]) >> 1
+extern void (*average)(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t n);
+
+// Sum of i * a[i]
+extern uint64_t (*moment)(const uint8_t* a, size_t n);
+
+// Of n interleaved bins of channels each: sums[c] and maxes[c] of channel c, and dst[i] = (bin of channel 0 + bin of the last one) >> 1;
+// vectorized for 2 and 4 channels, others by reference
+extern void (*scan_interleaved)(const uint8_t* bins, size_t channels, uint32_t* sums, uint8_t* maxes, uint8_t* dst, size_t n);
+
+// Returns name of chosen instruction set
+const char* init();
+
+}
+
+#endif
\ No newline at end of file
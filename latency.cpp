@@ -0,0 +1,82 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "config.hpp"
+#include "latency.hpp"
+
+LatencyProbe::LatencyProbe() {
+	this->period = size_t(PERIOD * cfg::SAMPLERATE);
+	this->tone = vector<int16_t>(size_t(TONE_DURATION * cfg::SAMPLERATE));
+	for (size_t i = 0; i < this->tone.size(); i++) {
+		this->tone[i] = int16_t(TONE_AMPLITUDE * sin(2.0 * M_PI * TONE_FREQUENCY * i / cfg::SAMPLERATE));
+	}
+	this->n_measured.store(0);
+	this->n_missed.store(0);
+	this->last_frames.store(0);
+	this->min_frames.store(UINT64_MAX);
+	this->max_frames.store(0);
+}
+
+void LatencyProbe::process(const int16_t* input, int16_t* output) {
+	for (size_t i = 0; i < cfg::BLOCKSIZE; i++) {
+		auto f = this->frame + i;
+		auto phase = f % this->period;
+
+		if (phase == 0) {
+			if (this->waiting) {
+				this->n_missed.store(this->n_missed.load(memory_order_relaxed) + 1, memory_order_relaxed);
+			}
+			this->emitted = f;
+			this->waiting = true;
+		}
+		int16_t v = (phase < this->tone.size()) ? this->tone[phase] : 0;
+		for (size_t c = 0; c < cfg::CHANNELS; c++) {
+			*output = v;
+			output++;
+		}
+
+		if (this->waiting && (input != NULL)) {
+			for (size_t c = 0; c < cfg::CHANNELS; c++) {
+				if (abs(input[i * cfg::CHANNELS + c]) > THRESHOLD) {
+					auto frames = f - this->emitted;
+					this->last_frames.store(frames, memory_order_relaxed);
+					if (frames < this->min_frames.load(memory_order_relaxed)) {
+						this->min_frames.store(frames, memory_order_relaxed);
+					}
+					if (frames > this->max_frames.load(memory_order_relaxed)) {
+						this->max_frames.store(frames, memory_order_relaxed);
+					}
+					this->n_measured.store(this->n_measured.load(memory_order_relaxed) + 1, memory_order_release);
+					this->waiting = false;
+					break;
+				}
+			}
+		}
+	}
+	this->frame += cfg::BLOCKSIZE;
+}
@@ -0,0 +1,41 @@
+#ifndef _LATENCY_HPP
+#define _LATENCY_HPP
+
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+// Loopback latency test: plays a short tone burst every PERIOD, and detects its arrival at sound input,
+// which must be connected to output (by cable, or "monitor" device). Runs in the callback of duplex stream,
+// so that emission and arrival are counted in frames of the same clock.
+class LatencyProbe {
+
+	static constexpr double PERIOD = 1.0; // sec
+	static constexpr double TONE_DURATION = 0.01; // sec
+	static constexpr double TONE_FREQUENCY = 1000.0; // Hz
+	static const int16_t TONE_AMPLITUDE = 0x4000;
+	static const int16_t THRESHOLD = 0x800; // at input
+
+	vector<int16_t> tone;
+	size_t period; // frames
+	uint64_t frame = 0; // of the block start
+	uint64_t emitted = 0; // frame of the last tone start
+	bool waiting = false; // for its arrival
+
+public:
+
+	// Written by the callback only
+	atomic<uint64_t> n_measured;
+	atomic<uint64_t> n_missed;
+	atomic<uint64_t> last_frames;
+	atomic<uint64_t> min_frames;
+	atomic<uint64_t> max_frames;
+
+	LatencyProbe();
+
+	void process(const int16_t* input, int16_t* output);
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped.hpp"
+
+int MappedFile::open(const string& path, size_t size, bool shared) {
+	this->close();
+	int fd = ::open(path.c_str(), shared ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return -1;
+	}
+	int existed = (size_t(st.st_size) == size) ? 0 : 1;
+	if (existed != 0) {
+		if (st.st_size != 0) { // contents of another size are not ours to wipe
+			fprintf(stderr, "\"%s\" has size %lu instead of %lu, not mapped.\n", path.c_str(), (unsigned long)(st.st_size), (unsigned long)size);
+			::close(fd);
+			return -1;
+		}
+		if (!shared || (ftruncate(fd, size) != 0)) {
+			::close(fd);
+			return -1;
+		}
+	}
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		::close(fd);
+		return -1;
+	}
+	this->fd = shared ? fd : -1;
+	if (!shared) {
+		::close(fd); // mapping keeps the file
+	}
+	this->ptr = (uint8_t*)ptr;
+	this->size = size;
+	return existed;
+}
+
+int MappedFile::open_readonly(const string& path) {
+	this->close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		::close(fd);
+		return -1;
+	}
+	void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // mapping keeps the file
+	if (ptr == MAP_FAILED) {
+		return -1;
+	}
+	this->ptr = (uint8_t*)ptr;
+	this->size = st.st_size;
+	return 0;
+}
+
+int MappedFile::open_anonymous(size_t size) {
+	this->close();
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		return -1;
+	}
+	this->ptr = (uint8_t*)ptr;
+	this->size = size;
+	return 0;
+}
+
+int MappedFile::sync(size_t offset, size_t length) {
+	if ((this->fd < 0) || (length == 0)) {
+		return 0;
+	}
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = offset - (offset % page);
+	return msync(this->ptr + start, offset + length - start, MS_SYNC);
+}
+
+void MappedFile::release(size_t offset, size_t length) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = (offset + page - 1) / page * page;
+	size_t end = (offset + length) / page * page;
+	if (end > start) {
+		madvise(this->ptr + start, end - start, MADV_DONTNEED);
+	}
+}
+
+void MappedFile::close() {
+	if (this->ptr != NULL) {
+		munmap(this->ptr, this->size);
+		this->ptr = NULL;
+		this->size = 0;
+	}
+	if (this->fd >= 0) {
+		::close(this->fd);
+		this->fd = -1;
+	}
+}
+
+MappedFile::~MappedFile() {
+	this->close();
+}
\ No newline at end of file
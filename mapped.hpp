@@ -0,0 +1,33 @@
+#ifndef _MAPPED_HPP
+#define _MAPPED_HPP
+
+#include <string>
+
+using namespace std;
+
+// Memory region mapped either from file, so that state is loaded without copying and saved by the kernel's writeback,
+// or anonymously, when nothing is to be saved
+class MappedFile {
+
+	int fd = -1;
+
+public:
+
+	uint8_t* ptr = NULL;
+	size_t size = 0;
+
+	// Maps file of exactly size bytes, creating it zeroed when absent or empty (returns 1 then, 0 if it existed);
+	// fails on file of another size, leaving it as is.
+	// Shared mapping writes through to file, private one is copy-on-write
+	int open(const string& path, size_t size, bool shared);
+	int open_readonly(const string& path); // whole file, private
+	int open_anonymous(size_t size);
+	int sync(size_t offset, size_t length); // blocks until range is on disk, no-op for anonymous mapping
+	void release(size_t offset, size_t length); // drops whole pages of range from memory, to be read back (or zeroed, if anonymous) when touched
+	void close();
+
+	~MappedFile();
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,245 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include "config.hpp"
+#include "midilog.hpp"
+
+const char MidiLog::MAGIC[8] = {'R', 'S', 'N', 'M', 'I', 'D', 'I', '1'};
+
+MidiLog::MidiLog(bool threaded) : events(QUEUE_EVENTS) {
+	this->threaded = threaded;
+	this->stopping.store(false);
+	this->n_recorded.store(0);
+	this->n_dropped.store(0);
+}
+
+int MidiLog::open(const string& path) {
+	this->path = path;
+	this->file = fopen(path.c_str(), "wb");
+	if (this->file == NULL) {
+		fprintf(stderr, "Cannot open \"%s\" for MIDI log: %s.\n", path.c_str(), strerror(errno));
+		return -1;
+	}
+	Header header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.samplerate = cfg::SAMPLERATE;
+	header.blocksize = cfg::BLOCKSIZE;
+	if (fwrite(&header, sizeof(header), 1, this->file) != 1) {
+		fprintf(stderr, "Cannot write MIDI log header to \"%s\": %s.\n", path.c_str(), strerror(errno));
+		fclose(this->file);
+		this->file = NULL;
+		return -1;
+	}
+	if (this->threaded) {
+		sem_init(&(this->sem), 0, 0);
+		this->worker = thread(&MidiLog::work, this);
+	}
+	return 0;
+}
+
+void MidiLog::write(const Event& event) {
+	if (this->file == NULL) {
+		this->n_dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	if (fwrite(&event, sizeof(event), 1, this->file) != 1) {
+		fprintf(stderr, "Cannot write MIDI log to \"%s\": %s.\n", this->path.c_str(), strerror(errno));
+		fclose(this->file);
+		this->file = NULL;
+		this->n_dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	this->n_recorded.store(this->n_recorded.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void MidiLog::record(const Event& event) {
+	if (!this->threaded) {
+		this->write(event);
+		return;
+	}
+	if (!this->events.push(event)) {
+		this->n_dropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+	sem_post(&(this->sem)); // async-signal-safe, does not lock
+}
+
+void MidiLog::drain() {
+	Event* event;
+	while ((event = this->events.peek()) != NULL) {
+		this->write(*event);
+		this->events.release();
+	}
+}
+
+void MidiLog::work() {
+	while (true) {
+		while ((sem_wait(&(this->sem)) != 0) && (errno == EINTR)) {
+		}
+		if (this->stopping.load(memory_order_acquire)) {
+			break;
+		}
+		this->drain();
+	}
+	this->drain();
+}
+
+void MidiLog::stop() {
+	if (this->threaded && this->worker.joinable()) {
+		this->stopping.store(true, memory_order_release);
+		sem_post(&(this->sem));
+		this->worker.join();
+		sem_destroy(&(this->sem));
+	}
+	if (this->file != NULL) {
+		fclose(this->file);
+		this->file = NULL;
+	}
+}
+
+int MidiLog::read(const string& path, Header& header, vector<Event>& events) {
+	auto file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open \"%s\" MIDI log: %s.\n", path.c_str(), strerror(errno));
+		return -1;
+	}
+	if ((fread(&header, sizeof(header), 1, file) != 1) || (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)) {
+		fprintf(stderr, "\"%s\" is not MIDI log.\n", path.c_str());
+		fclose(file);
+		return -1;
+	}
+	events.clear();
+	Event event;
+	while (fread(&event, sizeof(event), 1, file) == 1) {
+		events.push_back(event);
+	}
+	fclose(file);
+	return 0;
+}
+
+static void put_varlen(vector<uint8_t>& track, uint32_t value) {
+	uint8_t bytes[5];
+	size_t n = 0;
+	do {
+		bytes[n++] = value & 0x7F;
+		value >>= 7;
+	} while (value != 0);
+	while (n > 1) {
+		track.push_back(bytes[--n] | 0x80);
+	}
+	track.push_back(bytes[0]);
+}
+
+static void put_be(vector<uint8_t>& buf, uint32_t value, size_t n_bytes) {
+	for (size_t i = n_bytes; i > 0; i--) {
+		buf.push_back((value >> (8 * (i - 1))) & 0xFF);
+	}
+}
+
+static bool is_midi_data(int value) {
+	return (value >= 0) && (value < 0x80);
+}
+
+int MidiLog::export_smf(const Header& header, const vector<Event>& events, const string& path) {
+	const uint32_t TICKS_PER_QUARTER = 1000;
+	const uint32_t MUSEC_PER_QUARTER = 1000000; // so tick is 1 ms
+
+	vector<uint8_t> track;
+	put_varlen(track, 0);
+	track.insert(track.end(), {0xFF, 0x51, 0x03});
+	put_be(track, MUSEC_PER_QUARTER, 3);
+
+	uint64_t last_tick = 0;
+	for (auto& event : events) {
+		if (event.chan > 0xF) {
+			continue;
+		}
+		vector<uint8_t> msgs;
+		switch (event.type) {
+			case Event::NOTE_ON:
+				if (is_midi_data(event.data[0]) && is_midi_data(event.data[1])) {
+					msgs = {uint8_t(0x90 | event.chan), uint8_t(event.data[0]), uint8_t(event.data[1])};
+				}
+				break;
+			case Event::NOTE_OFF:
+				if (is_midi_data(event.data[0])) {
+					msgs = {uint8_t(0x80 | event.chan), uint8_t(event.data[0]), 0x40};
+				}
+				break;
+			case Event::CC:
+				if (is_midi_data(event.data[0]) && is_midi_data(event.data[1])) {
+					msgs = {uint8_t(0xB0 | event.chan), uint8_t(event.data[0]), uint8_t(event.data[1])};
+				}
+				break;
+			case Event::PROGRAM:
+				if ((event.data[1] >= 0) && (event.data[1] < 0x4000) && is_midi_data(event.data[2])) {
+					msgs = {uint8_t(0xB0 | event.chan), 0x00, uint8_t(event.data[1] >> 7), uint8_t(0xB0 | event.chan), 0x20, uint8_t(event.data[1] & 0x7F), uint8_t(0xC0 | event.chan), uint8_t(event.data[2])};
+				}
+				break;
+		}
+		if (msgs.empty()) {
+			continue;
+		}
+		uint64_t tick = (1000 * (uint64_t(event.i_blk) * header.blocksize + event.offset)) / header.samplerate;
+		size_t i = 0;
+		while (i < msgs.size()) {
+			put_varlen(track, uint32_t(tick - last_tick));
+			last_tick = tick;
+			size_t len = ((msgs[i] & 0xF0) == 0xC0) ? 2 : 3;
+			track.insert(track.end(), msgs.begin() + i, msgs.begin() + i + len);
+			i += len;
+		}
+	}
+	put_varlen(track, 0);
+	track.insert(track.end(), {0xFF, 0x2F, 0x00});
+
+	vector<uint8_t> smf = {'M', 'T', 'h', 'd'};
+	put_be(smf, 6, 4);
+	put_be(smf, 0, 2); // format 0, single track
+	put_be(smf, 1, 2);
+	put_be(smf, TICKS_PER_QUARTER, 2);
+	smf.insert(smf.end(), {'M', 'T', 'r', 'k'});
+	put_be(smf, track.size(), 4);
+	smf.insert(smf.end(), track.begin(), track.end());
+
+	auto file = fopen(path.c_str(), "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open \"%s\" for MIDI file: %s.\n", path.c_str(), strerror(errno));
+		return -1;
+	}
+	if (fwrite(smf.data(), smf.size(), 1, file) != 1) {
+		fprintf(stderr, "Cannot write MIDI file to \"%s\": %s.\n", path.c_str(), strerror(errno));
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+	return 0;
+}
+
+MidiLog::~MidiLog() {
+	this->stop();
+}
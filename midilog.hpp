@@ -0,0 +1,125 @@
+#ifndef _MIDILOG_HPP
+#define _MIDILOG_HPP
+
+#include <fluidsynth.h>
+
+#include <atomic>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc.hpp"
+
+using namespace std;
+
+// Log of events sent to synth, each with block of ensemble (since start) and sample offset in it, so that synth can be driven
+// by the same events again without players, and they can be exported to Standard MIDI File.
+// File is a header followed by fixed-size events. Sound thread records them to wait-free queue and posts a semaphore,
+// the worker thread writes them; without thread, e.g. in offline render, they are written at record().
+class MidiLog {
+
+public:
+
+	struct Event {
+		enum Type : uint8_t {
+			NOTE_ON, // key, velocity
+			NOTE_OFF, // key
+			CC, // controller, value
+			PROGRAM // SFIDS value, bank, program
+		};
+
+		uint32_t i_blk;
+		uint16_t offset; // in samples; players' events are all at start of block
+		uint8_t type;
+		uint8_t chan;
+		int16_t data[3]; // as sent, even if invalid for synth
+		uint16_t reserved;
+	};
+
+	struct Header {
+		char magic[8];
+		uint32_t samplerate;
+		uint32_t blocksize;
+	};
+
+	static const char MAGIC[8];
+	static const size_t QUEUE_EVENTS = 0x1000;
+
+private:
+
+	string path;
+	FILE* file = NULL;
+	SpscRing<Event> events;
+	bool threaded;
+	sem_t sem;
+	atomic<bool> stopping;
+	thread worker;
+
+	void work();
+	void drain();
+	void write(const Event& event);
+
+public:
+
+	atomic<uint64_t> n_recorded;
+	atomic<uint64_t> n_dropped; // when queue is full or file has failed
+
+	MidiLog(bool threaded);
+
+	int open(const string& path); // for recording, returns 0, or -1 after printing the reason to stderr
+	void record(const Event& event); // by the only producer thread
+	void stop(); // writes queued events and closes file
+
+	// Reads whole log, returns 0, or -1 after printing the reason to stderr
+	static int read(const string& path, Header& header, vector<Event>& events);
+
+	// Tick is 1 ms; channels above 15 and values invalid for MIDI are skipped, programs become bank selects & program changes
+	static int export_smf(const Header& header, const vector<Event>& events, const string& path);
+
+	~MidiLog();
+
+};
+
+// What ensemble and players send to synth: forwarded to it, and recorded to log, if any
+class MidiOut {
+
+	fluid_synth_t* synth;
+
+	inline void record(uint8_t type, int chan, int data0, int data1, int data2) {
+		if (this->log != NULL) {
+			this->log->record(MidiLog::Event{uint32_t(this->i_blk), 0, type, uint8_t(chan), {int16_t(data0), int16_t(data1), int16_t(data2)}, 0});
+		}
+	}
+
+public:
+
+	MidiLog* log = NULL;
+	uint64_t i_blk = 0; // of ensemble, since start
+
+	MidiOut(fluid_synth_t* synth = NULL) : synth(synth) {}
+
+	inline void noteon(int chan, int key, int vel) {
+		fluid_synth_noteon(this->synth, chan, key, vel);
+		this->record(MidiLog::Event::NOTE_ON, chan, key, vel, 0);
+	}
+
+	inline void noteoff(int chan, int key) {
+		fluid_synth_noteoff(this->synth, chan, key);
+		this->record(MidiLog::Event::NOTE_OFF, chan, key, 0, 0);
+	}
+
+	inline void cc(int chan, int ctrl, int val) {
+		fluid_synth_cc(this->synth, chan, ctrl, val);
+		this->record(MidiLog::Event::CC, chan, ctrl, val, 0);
+	}
+
+	// Program already selected at synth, by sfid of soundfont sf
+	inline void record_program(int chan, size_t sf, int bank, int num) {
+		this->record(MidiLog::Event::PROGRAM, chan, sf, bank, num);
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <chrono>
+#include <stdio.h>
+
+#include "config.hpp"
+#include "offline.hpp"
+#include "wav.hpp"
+
+static string dump_path(const string& output_path, const char* suffix) {
+	auto i_dot = output_path.rfind('.');
+	auto i_slash = output_path.rfind('/');
+	if ((i_dot == string::npos) || ((i_slash != string::npos) && (i_dot < i_slash))) {
+		return output_path + suffix;
+	}
+	return output_path.substr(0, i_dot) + suffix;
+}
+
+// Columns of spectrogram slices, low frequencies at the bottom, 1st channel in green and 2nd in red (or blue, if blue_first)
+static void dump_spectrogram(const string& path, const uint8_t* spectrogram, size_t n_columns, bool blue_first) {
+	auto image = cv::Mat(cfg::BANDWIDTH, n_columns, CV_8UC3);
+	auto off_first = blue_first ? 0 : 1;
+	for (size_t x = 0; x < n_columns; x++) {
+		auto spg = spectrogram + x * cfg::BANDWIDTH * cfg::CHANNELS + (cfg::BANDWIDTH - 1) * cfg::STRIDE;
+		auto last = (cfg::CHANNELS - 1) * cfg::BINS_LANE;
+		auto pixel = image.data + x * 3;
+		for (size_t y = 0; y < cfg::BANDWIDTH; y++) {
+			pixel[0] = 0;
+			pixel[1] = 0;
+			pixel[2] = 0;
+			pixel[off_first] = *spg;
+			pixel[2] = *(spg + last);
+			spg -= cfg::STRIDE;
+			pixel += n_columns * 3;
+		}
+	}
+	cv::imwrite(path, image);
+}
+
+static void dump_eventogram(const string& path, const uint8_t* eventogram, size_t n_columns, size_t n_players) {
+	auto image = cv::Mat(n_players, n_columns, CV_8UC3);
+	for (size_t x = 0; x < n_columns; x++) {
+		auto evg = eventogram + x * n_players * 3;
+		auto pixel = image.data + x * 3;
+		for (size_t y = 0; y < n_players; y++) {
+			pixel[0] = evg[0];
+			pixel[1] = evg[1];
+			pixel[2] = evg[2];
+			evg += 3;
+			pixel += n_columns * 3;
+		}
+	}
+	cv::imwrite(path, image);
+}
+
+int Offline::run(const string& input_path, const string& output_path) {
+	WavReader reader;
+	if (reader.open(input_path) != 0) {
+		fprintf(stderr, "Cannot read \"%s\" as 16-bit PCM WAV or raw int16.\n", input_path.c_str());
+		return -1;
+	}
+	if (reader.samplerate != cfg::SAMPLERATE) {
+		fprintf(stderr, "Sample rate of \"%s\" is %lu, but must be %lu.\n", input_path.c_str(), reader.samplerate, cfg::SAMPLERATE);
+		return -1;
+	}
+
+	WavWriter writer;
+	if (writer.open(output_path) != 0) {
+		fprintf(stderr, "Cannot write \"%s\".\n", output_path.c_str());
+		return -1;
+	}
+
+	auto ensemble = this->ctrl->ensemble;
+	auto echoes = this->ctrl->echoes;
+	auto n_players = ensemble->get_players_num();
+	auto n_blocks = (reader.frames + cfg::BLOCKSIZE - 1) / cfg::BLOCKSIZE;
+
+	vector<int16_t> input(cfg::BLOCKSIZE * cfg::CHANNELS);
+	vector<int16_t> output(cfg::BLOCKSIZE * cfg::CHANNELS);
+	// Whole-session synth spectrogram and eventogram, not just the last WIDTH blocks kept by ensemble
+	vector<uint8_t> synth_spectrogram(n_blocks * cfg::BANDWIDTH * cfg::CHANNELS);
+	vector<uint8_t> eventogram(n_blocks * n_players * 3);
+
+	auto t_start = chrono::steady_clock::now();
+
+	size_t n_frames;
+	for (size_t i_blk = 0; i_blk < n_blocks; i_blk++) {
+		n_frames = reader.read(input.data(), cfg::BLOCKSIZE);
+		// Same order as after streams start: output goes first, then input catches up
+		this->ctrl->process_output(output.data());
+		this->ctrl->process_input(input.data());
+		echoes->tend(); // after each block, so that none is missed however fast
+		writer.write(output.data(), n_frames);
+
+		auto ex = (ensemble->pos_blk.load() + cfg::WIDTH - 1) % cfg::WIDTH;
+		memcpy(synth_spectrogram.data() + i_blk * cfg::BANDWIDTH * cfg::CHANNELS, ensemble->spectrogram.data() + ex * cfg::BANDWIDTH * cfg::CHANNELS, cfg::BANDWIDTH * cfg::CHANNELS);
+		memcpy(eventogram.data() + i_blk * n_players * 3, ensemble->eventogram.data() + ex * n_players * 3, n_players * 3);
+	}
+
+	if (n_blocks > 0) {
+		this->ctrl->write_echoes(); // the last input block, otherwise taken from the ring at the next output block
+	}
+
+	auto t_finish = chrono::steady_clock::now();
+
+	reader.close();
+	writer.close();
+
+	double elapsed_sec = 1e-6 * chrono::duration_cast<chrono::microseconds>(t_finish - t_start).count();
+	double audio_sec = double(n_blocks * cfg::BLOCKSIZE) / cfg::SAMPLERATE;
+	printf("%lu blocks (%.3f sec of sound) in %.3f sec: %.1f blocks/sec, %.1f x real time ✅ dumps… ", n_blocks, audio_sec, elapsed_sec, n_blocks / elapsed_sec, audio_sec / elapsed_sec);
+	fflush(stdout);
+
+	dump_spectrogram(dump_path(output_path, ".echoes.png"), echoes->spectrogram, cfg::BLOCKS, false);
+	dump_spectrogram(dump_path(output_path, ".synth.png"), synth_spectrogram.data(), n_blocks, true);
+	dump_eventogram(dump_path(output_path, ".events.png"), eventogram.data(), n_blocks, n_players);
+
+	printf("✅\n");
+
+	return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef _OFFLINE_HPP
+#define _OFFLINE_HPP
+
+#include <string>
+
+#include "controller.hpp"
+
+using namespace std;
+
+// Pumps blocks from file through the same Controller processing as sound streams do, as fast as CPU allows
+class Offline {
+
+	Controller* ctrl;
+
+public:
+
+	Offline(Controller* ctrl) : ctrl(ctrl) {}
+
+	int run(const string& input_path, const string& output_path);
+
+};
+
+#endif
\ No newline at end of file
@@ -28,29 +28,35 @@ along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 
 using namespace std;
 
-Drummer::Drummer(fluid_synth_t* synth, const vector<int>& sfids, int& new_channel) {
+Drummer::Drummer(int& new_channel) {
     this->chan_tt = new_channel++;
     this->chan_d = new_channel++;
-    fluid_synth_program_select(synth, this->chan_tt, sfids[SFIDS::TINY], 0, GMSS::WOODBLOCK);
-    fluid_synth_program_select(synth, this->chan_d, sfids[SFIDS::LARGE], 0x80, 0); // drums
     this->last_tt_pitch = 60;
 }
 
-tuple<uint8_t, uint8_t, uint8_t> Drummer::react(fluid_synth_t* synth, const vector<uint8_t>& spectrogram, size_t i_blk, const SpectrumStats& spectrum_stats) {
+vector<Player::Program> Drummer::get_programs() {
+    return {{this->chan_tt, SFIDS::TINY, 0, GMSS::WOODBLOCK}, {this->chan_d, SFIDS::LARGE, 0x80, 0}}; // tick-tock, drums
+}
+
+vector<Player::Cue> Drummer::get_cues() {
+    return {{0x10, 4}, {0x10, 8}}; // tick-tock, drum
+}
+
+tuple<uint8_t, uint8_t, uint8_t> Drummer::react(MidiOut& out, size_t i_blk, const Features& features) {
     tuple<uint8_t, uint8_t, uint8_t> r = {0, 0, 0};
     // Tick-tock
     if ((i_blk & 0xF) == 4) {
-        fluid_synth_noteoff(synth, this->chan_tt, this->last_tt_pitch);
+        out.noteoff(this->chan_tt, this->last_tt_pitch);
         this->last_tt_pitch = 128 - this->last_tt_pitch;
-        fluid_synth_noteon(synth, this->chan_tt, this->last_tt_pitch, 70);
-        fluid_synth_cc(synth, this->chan_tt, 10, 64 + (this->last_tt_pitch - 64) * 15); // panorama
+        out.noteon(this->chan_tt, this->last_tt_pitch, 70);
+        out.cc(this->chan_tt, 10, 64 + (this->last_tt_pitch - 64) * 15); // panorama
         r = {0, 0xFF, 0};
     }
     // Drum
     if ((i_blk & 0xF) == 8) {
-        if (spectrum_stats.mean > 0x80) {
-            fluid_synth_noteoff(synth, this->chan_d, GMPM::ACOUSTIC_SNARE);
-            fluid_synth_noteon(synth, this->chan_d, GMPM::ACOUSTIC_SNARE, 80);
+        if (features.mean > 0x80) {
+            out.noteoff(this->chan_d, GMPM::ACOUSTIC_SNARE);
+            out.noteon(this->chan_d, GMPM::ACOUSTIC_SNARE, 80);
             r = {0, get<1>(r), 0xFF};
         } else {
             r = {0, get<1>(r), 0x40};
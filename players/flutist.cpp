@@ -27,29 +27,34 @@ along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 #include "scales.hpp"
 #include "../soundfonts.hpp"
 
-Flutist::Flutist(fluid_synth_t* synth, const vector<int>& sfids, int& new_channel) {
+Flutist::Flutist(int& new_channel) {
     this->chan = new_channel;
     new_channel++;
-    fluid_synth_program_select(synth, this->chan, sfids[SFIDS::SMALL], 0, GMSS::PAN_FLUTE);
     this->last_pitch = -1;
 }
 
-tuple<uint8_t, uint8_t, uint8_t> Flutist::react(fluid_synth_t* synth, const vector<uint8_t>& spectrogram, size_t i_blk, const SpectrumStats& spectrum_stats) {
+vector<Player::Program> Flutist::get_programs() {
+    return {{this->chan, SFIDS::SMALL, 0, GMSS::PAN_FLUTE}};
+}
+
+vector<Player::Cue> Flutist::get_cues() {
+    return {{0x40, 0x30}};
+}
+
+tuple<uint8_t, uint8_t, uint8_t> Flutist::react(MidiOut& out, size_t i_blk, const Features& features) {
     tuple<uint8_t, uint8_t, uint8_t> r = {0, 0, 0};
-    if ((i_blk & 0x3F) == 0x30) {
-        if (spectrum_stats.max > 0x80) {
-            int pitch = this->scale[(this->scale.size() * spectrum_stats.argmax / (cfg::BANDWIDTH >> 2)) % this->scale.size()];
-            if (pitch != this->last_pitch) {
-                fluid_synth_noteoff(synth, this->chan, this->last_pitch);
-                this->last_pitch = pitch;
-                fluid_synth_noteon(synth, this->chan, this->last_pitch, 80);
-                r = {0xFF, 0xFF, 0xFF};
-            } else {
-                r = {0x80, 0x80, 0x80};
-            }
+    if (features.max > 0x80) {
+        int pitch = this->scale[(this->scale.size() * features.argmax / (cfg::BANDWIDTH >> 2)) % this->scale.size()];
+        if (pitch != this->last_pitch) {
+            out.noteoff(this->chan, this->last_pitch);
+            this->last_pitch = pitch;
+            out.noteon(this->chan, this->last_pitch, 80);
+            r = {0xFF, 0xFF, 0xFF};
         } else {
-            r = {0x40, 0x40, 0x40};
-        }            
-    }
+            r = {0x80, 0x80, 0x80};
+        }
+    } else {
+        r = {0x40, 0x40, 0x40};
+    }            
     return r;       
 }
@@ -26,40 +26,45 @@ along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 #include "gmtimbres.hpp"
 #include "../soundfonts.hpp"
 
-Pianist::Pianist(fluid_synth_t* synth, const vector<int>& sfids, int& new_channel) {
+Pianist::Pianist(int& new_channel) {
     this->chan = new_channel;
     new_channel++;
-    fluid_synth_program_select(synth, this->chan, sfids[SFIDS::LARGE], 0, GMSS::ACOUSTIC_GRAND_PIANO);
     this->last_pitch1 = -1;
     this->last_pitch2 = -1;
     this->last_pitch3 = -1;
 }
 
-tuple<uint8_t, uint8_t, uint8_t> Pianist::react(fluid_synth_t* synth, const vector<uint8_t>& spectrogram, size_t i_blk, const SpectrumStats& spectrum_stats) {
+vector<Player::Program> Pianist::get_programs() {
+    return {{this->chan, SFIDS::LARGE, 0, GMSS::ACOUSTIC_GRAND_PIANO}};
+}
+
+vector<Player::Cue> Pianist::get_cues() {
+    return {{0x20, 0}};
+}
+
+tuple<uint8_t, uint8_t, uint8_t> Pianist::react(MidiOut& out, size_t i_blk, const Features& features) {
     tuple<uint8_t, uint8_t, uint8_t> r = {0, 0, 0};
-    if ((i_blk & 0x1F) == 0) {
-        int pitch = this->scale[this->scale.size() - 1 - ((this->scale.size() * spectrum_stats.argmax / (cfg::BANDWIDTH >> 2)) % this->scale.size())];
-        int n = 0;
-        if (spectrum_stats.max > 0xB0) {
-            fluid_synth_noteoff(synth, this->chan, this->last_pitch1);
-            this->last_pitch1 = pitch;
-            fluid_synth_noteon(synth, this->chan, this->last_pitch1, 70);
-            n++;
-        }
-        if (spectrum_stats.max > 0xC0) {
-            fluid_synth_noteoff(synth, this->chan, this->last_pitch2);
-            this->last_pitch2 = pitch + 4;
-            fluid_synth_noteon(synth, this->chan, this->last_pitch2, 60);
-            n++;
-        }
-        if (spectrum_stats.max > 0xD0) {
-            fluid_synth_noteoff(synth, this->chan, this->last_pitch3);
-            this->last_pitch3 = pitch + 7;
-            fluid_synth_noteon(synth, this->chan, this->last_pitch3, 70);
-            n++;
-        }
-        int c = 0x3F + (n << 6);
-        r = {c, c, c};
+    int pitch = this->scale[this->scale.size() - 1 - ((this->scale.size() * features.argmax / (cfg::BANDWIDTH >> 2)) % this->scale.size())];
+    int n = 0;
+    if (features.max > 0xB0) {
+        out.noteoff(this->chan, this->last_pitch1);
+        this->last_pitch1 = pitch;
+        out.noteon(this->chan, this->last_pitch1, 70);
+        n++;
+    }
+    if (features.max > 0xC0) {
+        out.noteoff(this->chan, this->last_pitch2);
+        this->last_pitch2 = pitch + 4;
+        out.noteon(this->chan, this->last_pitch2, 60);
+        n++;
+    }
+    if (features.max > 0xD0) {
+        out.noteoff(this->chan, this->last_pitch3);
+        this->last_pitch3 = pitch + 7;
+        out.noteon(this->chan, this->last_pitch3, 70);
+        n++;
     }
+    int c = 0x3F + (n << 6);
+    r = {c, c, c};
     return r;       
 }
@@ -14,8 +14,10 @@ class Pianist : public Player {
 
 public:
 
-    Pianist(fluid_synth_t* synth, const vector<int>& sfids, int& new_channel);
-    tuple<uint8_t, uint8_t, uint8_t> react(fluid_synth_t* synth, const vector<uint8_t>& spectrogram, size_t i_blk, const SpectrumStats& spectrum_stats);
+    Pianist(int& new_channel);
+    vector<Program> get_programs();
+    vector<Cue> get_cues();
+    tuple<uint8_t, uint8_t, uint8_t> react(MidiOut& out, size_t i_blk, const Features& features);
 
 };
 
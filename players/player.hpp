@@ -1,13 +1,12 @@
 #ifndef _PLAYER_HPP
 #define _PLAYER_HPP
 
-#include <fluidsynth.h>
-
 #include <tuple>
 #include <vector>
 
 #include "../config.hpp"
-#include "../spectrumstats.hpp"
+#include "../features.hpp"
+#include "../midilog.hpp"
 
 using namespace std;
 
@@ -15,7 +14,28 @@ class Player {
 
 public:
 
-    virtual tuple<uint8_t, uint8_t, uint8_t> react(fluid_synth_t* synth, const vector<uint8_t>& spectrogram, size_t i_blk, const SpectrumStats& spectrum_stats) = 0;
+    // Player is due at blocks where i_blk % period == phase, period being power of 2
+    struct Cue {
+        size_t period;
+        size_t phase;
+    };
+
+    // Preset of soundfont (value of SFIDS) selected at player's channel
+    struct Program {
+        int chan;
+        size_t sf;
+        int bank;
+        int num;
+    };
+
+    // Ensemble loads only these presets' samples, and selects them when their soundfonts are loaded (or failed to),
+    // bringing player online
+    virtual vector<Program> get_programs() = 0;
+
+    virtual vector<Cue> get_cues() = 0;
+
+    // Called only at due blocks; features are of the block i_blk of echoes, under reading head; events go to synth by out
+    virtual tuple<uint8_t, uint8_t, uint8_t> react(MidiOut& out, size_t i_blk, const Features& features) = 0;
 
     virtual ~Player() = default;
 };
@@ -26,30 +26,35 @@ along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 #include "gmtimbres.hpp"
 #include "../soundfonts.hpp"
 
-Singer::Singer(fluid_synth_t* synth, const vector<int>& sfids, int& new_channel) {
+Singer::Singer(int& new_channel) {
     this->chan = new_channel;
     new_channel++;
-    fluid_synth_program_select(synth, this->chan, sfids[SFIDS::LARGE], 0, GMSS::CHOIR_AAHS);
     this->last_pitch = -1;
 }
 
-tuple<uint8_t, uint8_t, uint8_t> Singer::react(fluid_synth_t* synth, const vector<uint8_t>& spectrogram, size_t i_blk, const SpectrumStats& spectrum_stats) {
+vector<Player::Program> Singer::get_programs() {
+    return {{this->chan, SFIDS::LARGE, 0, GMSS::CHOIR_AAHS}};
+}
+
+vector<Player::Cue> Singer::get_cues() {
+    return {{0x40, 0x20}};
+}
+
+tuple<uint8_t, uint8_t, uint8_t> Singer::react(MidiOut& out, size_t i_blk, const Features& features) {
     tuple<uint8_t, uint8_t, uint8_t> r = {0, 0, 0};
-    if ((i_blk & 0x3F) == 0x20) {
-        if (spectrum_stats.max > 0xA0) {
-            int pitch = this->scale[(this->scale.size() * spectrum_stats.argmax / (cfg::BANDWIDTH >> 2)) % this->scale.size()];
-            if (pitch != this->last_pitch) {
-                fluid_synth_noteoff(synth, this->chan, this->last_pitch);
-                this->last_pitch = pitch;
-                fluid_synth_noteon(synth, this->chan, this->last_pitch, 80);
-                fluid_synth_cc(synth, this->chan, 10, (i_blk >> 6) & 0x7F); // panorama
-                r = {0xFF, 0xFF, 0xFF};
-            } else {
-                r = {0x80, 0x80, 0x80};
-            }
+    if (features.max > 0xA0) {
+        int pitch = this->scale[(this->scale.size() * features.argmax / (cfg::BANDWIDTH >> 2)) % this->scale.size()];
+        if (pitch != this->last_pitch) {
+            out.noteoff(this->chan, this->last_pitch);
+            this->last_pitch = pitch;
+            out.noteon(this->chan, this->last_pitch, 80);
+            out.cc(this->chan, 10, (i_blk >> 6) & 0x7F); // panorama
+            r = {0xFF, 0xFF, 0xFF};
         } else {
-            r = {0x40, 0x40, 0x40};
-        }            
-    }
+            r = {0x80, 0x80, 0x80};
+        }
+    } else {
+        r = {0x40, 0x40, 0x40};
+    }            
     return r;       
 }
@@ -0,0 +1,101 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "pool.hpp"
+
+Pool::Pool(size_t n_threads) {
+	this->next_task.store(0);
+	for (size_t i = 1; i < n_threads; i++) {
+		this->workers.push_back(thread(&Pool::work, this));
+	}
+}
+
+void Pool::run_tasks() {
+	size_t i;
+	while ((i = this->next_task.fetch_add(1, memory_order_relaxed)) < this->n_tasks) {
+		(*(this->task))(i);
+		lock_guard<mutex> lock(this->pool_mutex);
+		this->n_done++;
+		if (this->n_done == this->n_tasks) {
+			this->done_cv.notify_all();
+		}
+	}
+}
+
+void Pool::work() {
+	uint64_t seen_batch = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(this->pool_mutex);
+			this->start_cv.wait(lock, [this, seen_batch]() { return this->stopping || (this->batch != seen_batch); });
+			if (this->stopping) {
+				return;
+			}
+			seen_batch = this->batch;
+			this->n_inside++;
+		}
+		this->run_tasks();
+		{
+			lock_guard<mutex> lock(this->pool_mutex);
+			this->n_inside--;
+			if (this->n_inside == 0) {
+				this->done_cv.notify_all();
+			}
+		}
+	}
+}
+
+void Pool::run(size_t n_tasks, const function<void(size_t)>& task) {
+	if (this->workers.empty()) {
+		for (size_t i = 0; i < n_tasks; i++) {
+			task(i);
+		}
+		return;
+	}
+	{
+		// Workers late for the previous batch must leave it before this one is set up
+		unique_lock<mutex> lock(this->pool_mutex);
+		this->done_cv.wait(lock, [this]() { return this->n_inside == 0; });
+		this->task = &task;
+		this->n_tasks = n_tasks;
+		this->n_done = 0;
+		this->next_task.store(0, memory_order_relaxed);
+		this->batch++;
+	}
+	this->start_cv.notify_all();
+	this->run_tasks();
+	unique_lock<mutex> lock(this->pool_mutex);
+	this->done_cv.wait(lock, [this]() { return (this->n_done == this->n_tasks) && (this->n_inside == 0); });
+}
+
+Pool::~Pool() {
+	{
+		lock_guard<mutex> lock(this->pool_mutex);
+		this->stopping = true;
+	}
+	this->start_cv.notify_all();
+	for (auto& worker : this->workers) {
+		worker.join();
+	}
+}
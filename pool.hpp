@@ -0,0 +1,48 @@
+#ifndef _POOL_HPP
+#define _POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed set of worker threads, which run batches of tasks together with the thread that submits a batch
+// and then waits for it to be done. Not for sound threads, as it locks.
+class Pool {
+
+	vector<thread> workers;
+	mutex pool_mutex;
+	condition_variable start_cv;
+	condition_variable done_cv;
+	bool stopping = false;
+
+	// Current batch, changed only when no worker is in it
+	const function<void(size_t)>* task = NULL;
+	size_t n_tasks = 0;
+	atomic<size_t> next_task;
+	size_t n_done = 0;
+	size_t n_inside = 0; // workers
+	uint64_t batch = 0;
+
+	void work();
+	void run_tasks();
+
+public:
+
+	Pool(size_t n_threads); // including the submitting one
+
+	size_t get_threads_num() {
+		return this->workers.size() + 1;
+	}
+
+	void run(size_t n_tasks, const function<void(size_t)>& task); // task(0…n_tasks-1), returns when all are done
+
+	~Pool();
+
+};
+
+#endif
\ No newline at end of file
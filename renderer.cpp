@@ -0,0 +1,303 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "analyzer.hpp"
+#include "config.hpp"
+#include "fastpath.hpp"
+#include "renderer.hpp"
+
+// Hot loops of rendering, specialized for common block sizes and channels counts, and by layout, see fastpath.hpp.
+// Each draws rows y_begin…y_end-1 of n_columns columns at xs from their slices, TILE_COLUMNS at a time,
+// so that the tile's slices stay in cache while its rows are written.
+
+// Columns of echoes spectrogram, 1st channel in green and last one in red
+struct DrawEchoesColumns {
+	template<size_t BS, size_t CH, bool PL>
+	static void run(uint32_t* fbdata_ptr, const size_t* xs, const uint8_t* const* slices, size_t n_columns, size_t y_begin, size_t y_end) {
+		const size_t bandwidth = fast_blocksize<BS>() >> 1;
+		const size_t stride = fast_stride<CH, PL>();
+		const size_t last = (fast_channels<CH>() - 1) * fast_bins_lane<BS, PL>();
+		for (size_t i_tile = 0; i_tile < n_columns; i_tile += Renderer::TILE_COLUMNS) {
+			auto i_end = min(i_tile + Renderer::TILE_COLUMNS, n_columns);
+			auto fbdata_row_ptr = fbdata_ptr + y_begin * cfg::WIDTH;
+			for (size_t y = y_begin; y < y_end; y++) {
+				auto offs = (bandwidth - 1 - y) * stride;
+				for (size_t i = i_tile; i < i_end; i++) {
+					auto spg = slices[i] + offs;
+					fbdata_row_ptr[xs[i]] = (((uint32_t)(*spg)) << 8) + (((uint32_t)(*(spg + last))) << 0x10); // green & red
+				}
+				fbdata_row_ptr += cfg::WIDTH;
+			}
+		}
+	}
+};
+
+// Columns of synth spectrogram, 1st channel in blue and last one in red
+struct DrawSynthColumns {
+	template<size_t BS, size_t CH, bool PL>
+	static void run(uint32_t* fbdata_ptr, const size_t* xs, const uint8_t* const* slices, size_t n_columns, size_t y_begin, size_t y_end) {
+		const size_t bandwidth = fast_blocksize<BS>() >> 1;
+		const size_t stride = fast_stride<CH, PL>();
+		const size_t last = (fast_channels<CH>() - 1) * fast_bins_lane<BS, PL>();
+		for (size_t i_tile = 0; i_tile < n_columns; i_tile += Renderer::TILE_COLUMNS) {
+			auto i_end = min(i_tile + Renderer::TILE_COLUMNS, n_columns);
+			auto fbdata_row_ptr = fbdata_ptr + y_begin * cfg::WIDTH;
+			for (size_t y = y_begin; y < y_end; y++) {
+				auto offs = (bandwidth - 1 - y) * stride;
+				for (size_t i = i_tile; i < i_end; i++) {
+					auto spg = slices[i] + offs;
+					fbdata_row_ptr[xs[i]] = ((uint32_t)(*spg)) + (((uint32_t)(*(spg + last))) << 0x10); // blue & red
+				}
+				fbdata_row_ptr += cfg::WIDTH;
+			}
+		}
+	}
+};
+
+Renderer::Renderer(ColumnsSnapshot* echoes_sg, ColumnsSnapshot* averfade, ColumnsSnapshot* synth_sg, ColumnsSnapshot* eventogram, size_t n_players, Pool* pool) {
+	this->echoes_sg = echoes_sg;
+	this->averfade = averfade;
+	this->synth_sg = synth_sg;
+	this->eventogram = eventogram;
+	this->n_players = n_players;
+	this->pool = pool;
+	this->n_bands = min(pool->get_threads_num(), cfg::BANDWIDTH);
+
+	// Whole echoes loop is squeezed (or stretched) to echoes_width columns
+	this->echoes_width = cfg::WIDTH - 0x100;
+	this->echoes_x_begin = vector<size_t>(cfg::BLOCKS, 0);
+	this->echoes_x_end = vector<size_t>(cfg::BLOCKS, 0);
+	for (size_t x = 0; x < this->echoes_width; x++) {
+		auto i_blk = size_t(double(x) * cfg::BLOCKS / this->echoes_width);
+		if (this->echoes_x_begin[i_blk] == this->echoes_x_end[i_blk]) {
+			this->echoes_x_begin[i_blk] = x;
+		}
+		this->echoes_x_end[i_blk] = x + 1;
+	}
+	this->heads_x[0] = 0;
+	this->heads_x[1] = 0;
+
+	// Each column at most once, but echoes block columns and heads may overlap
+	this->echoes_xs.reserve(this->echoes_width + 2);
+	this->echoes_slices.reserve(this->echoes_width + 2);
+	this->synth_xs.reserve(cfg::WIDTH);
+	this->synth_slices.reserve(cfg::WIDTH);
+	this->events_xs.reserve(cfg::WIDTH);
+	this->ring_start = 0;
+	this->scroll = 0;
+
+	this->draw_echoes_columns = select_fastpath<DrawEchoesColumns>();
+	this->draw_synth_columns = select_fastpath<DrawSynthColumns>();
+
+	this->framebuf = cv::Mat(2 + cfg::BLOCKSIZE + n_players, cfg::WIDTH, CV_8UC4);
+	this->full = true;
+}
+
+void Renderer::add_echoes_column(size_t x) {
+	auto i_blk = size_t(double(x) * cfg::BLOCKS / this->echoes_width);
+	this->echoes_xs.push_back(x);
+	this->echoes_slices.push_back(this->echoes_sg->data.data() + i_blk * cfg::BANDWIDTH * cfg::CHANNELS);
+}
+
+void Renderer::add_synth_column(size_t x) {
+	auto ex = (this->ring_start + 0x100 + x) % cfg::WIDTH; // last WIDTH - 0x100 columns
+	this->synth_xs.push_back(x);
+	this->synth_slices.push_back(this->synth_sg->data.data() + ex * cfg::BANDWIDTH * cfg::CHANNELS);
+}
+
+void Renderer::draw_echoes_band(size_t y_begin, size_t y_end) {
+	this->draw_echoes_columns(this->row(0), this->echoes_xs.data(), this->echoes_slices.data(), this->echoes_xs.size(), y_begin, y_end);
+	// Heads, recording one over playing one
+	const uint32_t HEAD_COLORS[2] = {0xFF, 0}; // blue, black
+	for (size_t i = 0; i < 2; i++) {
+		auto fbdata_ptr = this->row(y_begin) + this->heads_x[i];
+		for (size_t y = y_begin; y < y_end; y++) {
+			*fbdata_ptr = HEAD_COLORS[i];
+			fbdata_ptr += cfg::WIDTH;
+		}
+	}
+}
+
+void Renderer::draw_synth_band(size_t y_begin, size_t y_end) {
+	auto fbdata_ptr = this->row(2 + cfg::BANDWIDTH + this->n_players);
+	this->scroll_rows(fbdata_ptr + y_begin * cfg::WIDTH, y_end - y_begin, cfg::WIDTH - 0x100);
+	this->draw_synth_columns(fbdata_ptr, this->synth_xs.data(), this->synth_slices.data(), this->synth_xs.size(), y_begin, y_end);
+}
+
+void Renderer::draw_eventogram() {
+	auto fbdata_row_ptr = this->row(1 + cfg::BANDWIDTH);
+	this->scroll_rows(fbdata_row_ptr, this->n_players, cfg::WIDTH);
+	for (auto x : this->events_xs) {
+		auto fbdata_ptr = fbdata_row_ptr + x;
+		auto evg = this->eventogram->data.data() + (((this->ring_start + x) % cfg::WIDTH) * this->n_players * 3);
+		for (size_t y = 0; y < this->n_players; y++) {
+			*fbdata_ptr = ((uint32_t)(*evg)) + (((uint32_t)(*(evg + 1))) << 8) + (((uint32_t)(*(evg + 2))) << 0x10);
+			fbdata_ptr += cfg::WIDTH;
+			evg += 3;
+		}
+	}
+	if (this->full) {
+		// Separators
+		auto fbdata_ptr = this->row(cfg::BANDWIDTH);
+		for (size_t x = 0; x < cfg::WIDTH; x++) {
+			fbdata_ptr[x] = 0x80; // blue
+		}
+		fbdata_ptr = this->row(1 + cfg::BANDWIDTH + this->n_players);
+		for (size_t x = 0; x < cfg::WIDTH; x++) {
+			fbdata_ptr[x] = 0x80 << 8; // green
+		}
+	}
+}
+
+// Bars of 0x100 pixels at most, of mean of 1st & last channels, from the top (highest frequency) row of spectrum
+void Renderer::draw_momentary(uint32_t* fbdata_row_ptr, const uint8_t* spg, size_t step, size_t last, uint32_t shift) {
+	for (size_t y = 0; y < cfg::BANDWIDTH; y++) {
+		auto avener = (((uint32_t)(*spg)) + ((uint32_t)(*(spg + last)))) >> 1;
+		auto avener_color = (0x80 + (avener >> 1)) << shift;
+		auto fbdata_ptr = fbdata_row_ptr;
+		for (size_t x = 0; x < avener; x++) {
+			*fbdata_ptr = avener_color;
+			fbdata_ptr++;
+		}
+		memset(fbdata_ptr, 0, (0x100 - avener) << 2); // rest of the line is black
+		spg -= step;
+		fbdata_row_ptr += cfg::WIDTH;
+	}
+}
+
+// Moves n_columns at the left of image rows by scroll to the left; exposed ones at the right are to be drawn
+void Renderer::scroll_rows(uint32_t* fbdata_row_ptr, size_t n_rows, size_t n_columns) {
+	if ((this->scroll == 0) || (this->scroll >= n_columns)) {
+		return;
+	}
+	for (size_t y = 0; y < n_rows; y++) {
+		memmove(fbdata_row_ptr, fbdata_row_ptr + this->scroll, (n_columns - this->scroll) << 2);
+		fbdata_row_ptr += cfg::WIDTH;
+	}
+}
+
+size_t Renderer::render(size_t pos_blk_read, size_t pos_blk_write, size_t ensemble_pos_blk) {
+	// Analysis lags behind the writing heads by its queue at most, and one more job being done
+	const size_t analysis_lag = Analyzer::QUEUE_JOBS + 2;
+	this->averfade->update();
+	if (this->full) {
+		this->echoes_sg->update();
+		this->synth_sg->update();
+		this->eventogram->update();
+	} else {
+		this->echoes_sg->update(pos_blk_write, analysis_lag);
+		this->synth_sg->update(ensemble_pos_blk, analysis_lag);
+		this->eventogram->update(ensemble_pos_blk, 1);
+	}
+
+	// Cannot use ensemble.pos_blk itself, because it can be updated by another thread in out_callback(),
+	// in the middle of the drawing; columns near it may be newer in the snapshots, which is harmless
+	auto ring_start = ensemble_pos_blk % cfg::WIDTH;
+	this->scroll = this->full ? 0 : ((ring_start + cfg::WIDTH - this->ring_start) % cfg::WIDTH);
+	this->ring_start = ring_start;
+
+	// Columns to draw
+	this->echoes_xs.clear();
+	this->echoes_slices.clear();
+	this->synth_xs.clear();
+	this->synth_slices.clear();
+	this->events_xs.clear();
+	size_t n = 0;
+	if (this->full) {
+		for (size_t x = 0; x < this->echoes_width; x++) {
+			this->add_echoes_column(x);
+		}
+		for (size_t x = 0; x < cfg::WIDTH - 0x100; x++) {
+			this->add_synth_column(x);
+		}
+		for (size_t x = 0; x < cfg::WIDTH; x++) {
+			this->events_xs.push_back(x);
+		}
+		n = cfg::BLOCKS + (cfg::WIDTH << 1);
+	} else {
+		for (auto i_blk : this->echoes_sg->updated) {
+			for (size_t x = this->echoes_x_begin[i_blk]; x < this->echoes_x_end[i_blk]; x++) {
+				this->add_echoes_column(x);
+			}
+		}
+		// Restore echoes under heads of previous frame
+		this->add_echoes_column(this->heads_x[0]);
+		this->add_echoes_column(this->heads_x[1]);
+		// Exposed at the right by scrolling, and published ones at the left of them
+		auto synth_x_exposed = cfg::WIDTH - 0x100 - min(this->scroll, cfg::WIDTH - 0x100);
+		for (size_t x = synth_x_exposed; x < cfg::WIDTH - 0x100; x++) {
+			this->add_synth_column(x);
+		}
+		for (auto ex : this->synth_sg->updated) {
+			auto x = (ex + (cfg::WIDTH << 1) - this->ring_start - 0x100) % cfg::WIDTH;
+			if (x < synth_x_exposed) {
+				this->add_synth_column(x);
+			}
+		}
+		auto events_x_exposed = cfg::WIDTH - this->scroll;
+		for (size_t x = events_x_exposed; x < cfg::WIDTH; x++) {
+			this->events_xs.push_back(x);
+		}
+		for (auto ex : this->eventogram->updated) {
+			auto x = (ex + cfg::WIDTH - this->ring_start) % cfg::WIDTH;
+			if (x < events_x_exposed) {
+				this->events_xs.push_back(x);
+			}
+		}
+		n = this->echoes_sg->updated.size() + this->synth_xs.size() + this->events_xs.size();
+	}
+	this->heads_x[0] = pos_blk_read * this->echoes_width / cfg::BLOCKS;
+	this->heads_x[1] = pos_blk_write * this->echoes_width / cfg::BLOCKS;
+
+	// Tiles: bands of echoes spectrogram, bands of synth spectrogram, eventogram, momentary spectra
+	this->pool->run((this->n_bands << 1) + 2, [this](size_t i_tile) {
+		if (i_tile < (this->n_bands << 1)) {
+			auto i_band = i_tile % this->n_bands;
+			auto y_begin = i_band * cfg::BANDWIDTH / this->n_bands;
+			auto y_end = (i_band + 1) * cfg::BANDWIDTH / this->n_bands;
+			if (i_tile < this->n_bands) {
+				this->draw_echoes_band(y_begin, y_end);
+			} else {
+				this->draw_synth_band(y_begin, y_end);
+			}
+		} else if (i_tile == (this->n_bands << 1)) {
+			this->draw_eventogram();
+		} else {
+			// Echoes fading-average one, and synth one of the newest column
+			this->draw_momentary(this->row(0) + this->echoes_width, this->averfade->data.data() + cfg::BANDWIDTH - 1, 1, 0, 0); // blue
+			auto ex = (this->ring_start + cfg::WIDTH - 1) % cfg::WIDTH;
+			this->draw_momentary(this->row(2 + cfg::BANDWIDTH + this->n_players) + cfg::WIDTH - 0x100, this->synth_sg->data.data() + ex * cfg::BANDWIDTH * cfg::CHANNELS + (cfg::BANDWIDTH - 1) * cfg::STRIDE, cfg::STRIDE, (cfg::CHANNELS - 1) * cfg::BINS_LANE, 8); // green
+		}
+	});
+
+	this->full = false;
+	return n;
+}
+
+void Renderer::clear() {
+	memset(this->framebuf.data, 0x40, ((2 + cfg::BLOCKSIZE + this->n_players) * cfg::WIDTH) << 2);
+	this->full = true;
+}
@@ -0,0 +1,76 @@
+#ifndef _RENDERER_HPP
+#define _RENDERER_HPP
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+#include "pool.hpp"
+#include "seqlock.hpp"
+
+using namespace std;
+
+// Window image kept between frames, where only columns published since previous frame are redrawn.
+// Echoes spectrogram is drawn in place, with heads restored from it as they move.
+// Eventogram and synth spectrogram are drawn straight into the image, their ensemble's ring columns offset by its pos_blk;
+// as it moves, their rows are scrolled in place, and only columns exposed or published since previous frame are drawn.
+// Snapshots poll only the columns their writers may have published since previous frame, but at full redraw.
+// Frame is composed by the pool, in tiles: horizontal bands of both spectrograms, eventogram, and momentary spectra.
+// Columns are drawn by blocks of TILE_COLUMNS, row by row, so that writes go along image rows.
+class Renderer {
+
+	ColumnsSnapshot* echoes_sg;
+	ColumnsSnapshot* averfade;
+	ColumnsSnapshot* synth_sg;
+	ColumnsSnapshot* eventogram;
+	size_t n_players;
+	Pool* pool;
+	size_t n_bands; // of each spectrogram
+
+	size_t echoes_width; // in columns, the rest of WIDTH is for momentary spectra
+	vector<size_t> echoes_x_begin; // of columns showing each block of echoes, none if begin == end
+	vector<size_t> echoes_x_end;
+	size_t heads_x[2]; // playing & recording ones
+
+	// Columns to draw at current frame, with their slices
+	vector<size_t> echoes_xs;
+	vector<const uint8_t*> echoes_slices;
+	vector<size_t> synth_xs;
+	vector<const uint8_t*> synth_slices;
+	vector<size_t> events_xs;
+	size_t ring_start; // column of both rings at the left of image
+	size_t scroll; // columns the rings moved by since previous frame
+
+	bool full; // redraw everything at next frame
+
+	void (*draw_echoes_columns)(uint32_t*, const size_t*, const uint8_t* const*, size_t, size_t, size_t);
+	void (*draw_synth_columns)(uint32_t*, const size_t*, const uint8_t* const*, size_t, size_t, size_t);
+
+	uint32_t* row(size_t y) {
+		return ((uint32_t*)this->framebuf.data) + y * this->framebuf.cols;
+	}
+
+	void add_echoes_column(size_t x);
+	void draw_echoes_band(size_t y_begin, size_t y_end);
+	void draw_synth_band(size_t y_begin, size_t y_end);
+	void draw_eventogram();
+	void draw_momentary(uint32_t* fbdata_row_ptr, const uint8_t* spg, size_t step, size_t last, uint32_t shift); // last - offset of last channel's bin from 1st one's
+	void scroll_rows(uint32_t* fbdata_row_ptr, size_t n_rows, size_t n_columns);
+	void add_synth_column(size_t x);
+
+public:
+
+	static const size_t TILE_COLUMNS = 0x10;
+
+	cv::Mat framebuf;
+
+	// Snapshots are updated by render()
+	Renderer(ColumnsSnapshot* echoes_sg, ColumnsSnapshot* averfade, ColumnsSnapshot* synth_sg, ColumnsSnapshot* eventogram, size_t n_players, Pool* pool);
+
+	// Returns number of spectrogram & eventogram columns redrawn
+	size_t render(size_t pos_blk_read, size_t pos_blk_write, size_t ensemble_pos_blk);
+	void clear(); // fills image with grey, then next render() redraws everything, e.g. after a pause
+
+};
+
+#endif
\ No newline at end of file
@@ -23,16 +23,29 @@ along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <opencv2/highgui.hpp>
-#include <opencv2/imgproc.hpp>
 
 #include <chrono>
+#include <memory>
+#include <sstream>
 #include <stdio.h>
 
+#include "analyzer.hpp"
 #include "config.hpp"
 #include "controller.hpp"
 #include "echoes.hpp"
+#include "exporter.hpp"
 #include "ensemble.hpp"
+#include "fastpath.hpp"
+#include "governor.hpp"
+#include "kernels.hpp"
+#include "latency.hpp"
+#include "midilog.hpp"
+#include "offline.hpp"
+#include "pool.hpp"
+#include "renderer.hpp"
+#include "seqlock.hpp"
 #include "streams.hpp"
+#include "timings.hpp"
 
 using namespace std;
 
@@ -45,151 +58,258 @@ int64_t time_musec() {
 	return chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now().time_since_epoch()).count();
 }
 
-int main() {
+void print_usage() {
+	printf("Usage:\n");
+	printf("  resonat [--duplex | --latency-test] [--export-png DIR | --export-raw PATH]\n");
+	printf("    real-time, with sound input & output and window; --duplex opens one full-duplex stream instead of separate input & output ones,\n");
+	printf("    --latency-test also measures round-trip latency by tone bursts, with output looped back to input, and leaves echoes intact;\n");
+	printf("    --export-png writes window frames to DIR as numbered PNGs, --export-raw as raw RGBA video to PATH, which may be named pipe of encoder\n");
+	printf("  resonat --offline INPUT OUTPUT [--resume] [--echoes-out] [--no-synth-out]\n");
+	printf("    headless, as fast as possible, from INPUT (16-bit PCM WAV or raw int16) to OUTPUT (WAV),\n");
+	printf("    also dumping OUTPUT.{echoes,synth,events}.png; --resume starts from saved echoes, which are never saved back\n");
+	printf("  Both accept [--players NAME,…] [--record LOG | --replay LOG] [--config FILE] [--set NAME=VALUE]…\n");
+	printf("    --players composes ensemble at runtime of named ones (drummer, flutist, pianist, singer) instead of the built-in line-up of all 4;\n");
+	printf("    --record logs events sent to synth to LOG, --replay drives synth by events of LOG instead of players;\n");
+	printf("    --config and --set override parameters of config.cpp (SAMPLERATE, BLOCKSIZE, DURATION, CHANNELS, WIDTH…) by FILE of NAME = VALUE lines, then by each --set\n");
+	printf("  resonat --to-midi LOG OUTPUT\n");
+	printf("    converts LOG of events to Standard MIDI File\n");
+}
+
+int main(int argc, char* argv[]) {
 	printf("ReSonat v%s © Sunkware\n", VERSION);
 
+	bool offline = false;
+	bool resume = false;
+	string offline_input_path, offline_output_path;
+	bool do_synth_out = true;
+	bool do_echoes_out = false;
+	bool duplex = false;
+	bool latency_test = false;
+	string export_path;
+	auto export_format = Exporter::PNG;
+	string record_path, replay_path;
+	string midi_log_path, midi_output_path;
+	bool custom_players = false;
+	vector<string> player_names;
+	string config_path;
+	vector<string> config_sets;
+	for (int i = 1; i < argc; i++) {
+		auto arg = string(argv[i]);
+		if ((arg == "--offline") && (i + 2 < argc)) {
+			offline = true;
+			offline_input_path = argv[++i];
+			offline_output_path = argv[++i];
+		} else if (arg == "--resume") {
+			resume = true;
+		} else if (arg == "--echoes-out") {
+			do_echoes_out = true;
+		} else if (arg == "--no-synth-out") {
+			do_synth_out = false;
+		} else if (arg == "--duplex") {
+			duplex = true;
+		} else if (arg == "--latency-test") {
+			duplex = true;
+			latency_test = true;
+		} else if ((arg == "--export-png") && (i + 1 < argc)) {
+			export_path = argv[++i];
+			export_format = Exporter::PNG;
+		} else if ((arg == "--export-raw") && (i + 1 < argc)) {
+			export_path = argv[++i];
+			export_format = Exporter::RAW;
+		} else if ((arg == "--players") && (i + 1 < argc)) {
+			custom_players = true;
+			stringstream names(argv[++i]);
+			string name;
+			while (getline(names, name, ',')) {
+				player_names.push_back(name);
+			}
+		} else if ((arg == "--record") && (i + 1 < argc)) {
+			record_path = argv[++i];
+		} else if ((arg == "--replay") && (i + 1 < argc)) {
+			replay_path = argv[++i];
+		} else if ((arg == "--to-midi") && (i + 2 < argc)) {
+			midi_log_path = argv[++i];
+			midi_output_path = argv[++i];
+		} else if ((arg == "--config") && (i + 1 < argc)) {
+			config_path = argv[++i];
+		} else if ((arg == "--set") && (i + 1 < argc) && (string(argv[i + 1]).find('=') != string::npos)) {
+			config_sets.push_back(argv[++i]);
+		} else {
+			print_usage();
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+	resume = resume || !offline; // real-time run always continues
+
+	if (!midi_log_path.empty()) {
+		MidiLog::Header header;
+		vector<MidiLog::Event> events;
+		if ((MidiLog::read(midi_log_path, header, events) != 0) || (MidiLog::export_smf(header, events, midi_output_path) != 0)) {
+			return 1;
+		}
+		printf("%lu events converted\n", events.size());
+		return 0;
+	}
+
+	if (!config_path.empty() && (cfg::load(config_path) != 0)) {
+		return 1;
+	}
+	for (auto& config_set : config_sets) {
+		auto eq = config_set.find('=');
+		if (cfg::set(config_set.substr(0, eq), config_set.substr(eq + 1)) != 0) {
+			return 1;
+		}
+	}
+	if (cfg::derive() != 0) {
+		return 1;
+	}
+	// Config must not change from now on, fast paths are chosen by it
+
 	printf("Starting: ensemble… ");
 	fflush(stdout);
 
-	Ensemble ensemble;
+	// Built-in line-up calls its players directly, custom one through virtual react()
+	unique_ptr<Ensemble> ensemble_ptr(custom_players ? (Ensemble*)(new DynamicEnsemble(player_names)) : (Ensemble*)(new DefaultEnsemble()));
+	Ensemble& ensemble = *ensemble_ptr;
 
 	auto n_players = ensemble.get_players_num();
+	if (n_players == 0) {
+		fprintf(stderr, "No players in ensemble.\n");
+		return 1;
+	}
 
-	printf("synth, %lu soundfonts, %lu players ✅ echoes… ", ensemble.get_sfids_num(), n_players);
+	printf("synth, %lu soundfonts loading, %lu players ✅ echoes… ", ensemble.get_sfids_num(), n_players);
 	fflush(stdout);
 
+	auto kernels_isa = kernels::init();
+
 	Echoes echoes;
 
-	if (echoes.load() == 0) {
+	if (resume && (echoes.load(!offline) == 0)) {
 		printf("loaded ");
 	} else {
 		printf("inited ");
 	}
 
-	auto ctrl = Controller{&ensemble, &echoes};
+	Timings timings(n_players);
+	ensemble.timings = &timings;
+	echoes.timings = &timings;
 
-	printf("%lu blocks ✅ streams… ", cfg::BLOCKS);
-	fflush(stdout);
+	Analyzer analyzer(!offline); // offline render needs no thread, and keeps results deterministic
+	analyzer.timings = &timings;
+	ensemble.analyzer = &analyzer;
+	echoes.analyzer = &analyzer;
 
-	Streams streams;
+	MidiLog midilog(!offline);
+	if (!record_path.empty()) {
+		if (midilog.open(record_path) != 0) {
+			return 1;
+		}
+		ensemble.midilog = &midilog;
+	}
+	vector<MidiLog::Event> replay_events;
+	if (!replay_path.empty()) {
+		MidiLog::Header header;
+		if (MidiLog::read(replay_path, header, replay_events) != 0) {
+			return 1;
+		}
+		if ((header.samplerate != cfg::SAMPLERATE) || (header.blocksize != cfg::BLOCKSIZE)) {
+			fprintf(stderr, "\"%s\" MIDI log is of SAMPLERATE %u and BLOCKSIZE %u, not of config.\n", replay_path.c_str(), header.samplerate, header.blocksize);
+			return 1;
+		}
+		ensemble.replay = &replay_events;
+	}
 
-	streams.start(&ctrl);
+	Controller ctrl(&ensemble, &echoes);
+	ctrl.do_synth_out.store(do_synth_out);
+	ctrl.do_echoes_out.store(do_echoes_out);
+	ctrl.timings = &timings;
 
-	printf("✅ tables… ");
-	fflush(stdout);
+	if (offline) {
+		printf("%lu blocks, %s kernels, %s loops ✅ offline… ", cfg::BLOCKS, kernels_isa, is_fastpath() ? "specialized" : "generic");
+		fflush(stdout);
 
-	auto offscaletab = vector<vector<size_t>>(cfg::BANDWIDTH);
-	for (size_t y = 0; y < cfg::BANDWIDTH; y++) {
-		offscaletab[y] = vector<size_t>(cfg::WIDTH - 0x100);
-		for (size_t x = 0; x < (cfg::WIDTH - 0x100); x++) {
-			offscaletab[y][x] = (size_t(double(x) * cfg::BLOCKS / (cfg::WIDTH - 0x100)) * cfg::BANDWIDTH + (cfg::BANDWIDTH - 1 - y)) * cfg::CHANNELS;
+		ensemble.wait_soundfonts(); // all players online from the 1st block, so render is deterministic
+		ensemble.report_soundfonts(stdout);
+
+		Offline offline_render(&ctrl);
+		if (offline_render.run(offline_input_path, offline_output_path) != 0) {
+			return 1;
+		}
+		timings.report(stdout);
+		midilog.stop();
+		if (!record_path.empty()) {
+			printf("MIDI log: %lu events, %lu dropped\n", midilog.n_recorded.load(), midilog.n_dropped.load());
 		}
+		return 0;
 	}
 
-	vector<size_t> widthmodtab(cfg::WIDTH << 1);
-	for (size_t i = 0; i < (cfg::WIDTH << 1); i++) {
-		widthmodtab[i] = i % cfg::WIDTH;
+	printf("%lu blocks, %s kernels, %s loops ✅ streams… ", cfg::BLOCKS, kernels_isa, is_fastpath() ? "specialized" : "generic");
+	fflush(stdout);
+
+	Streams streams;
+
+	// UI draws from own copies, updated with columns published by sound & analysis threads since previous frame
+	ColumnsSnapshot echoes_sg_snap(echoes.spectrogram, echoes.spectrogram_locks.get(), cfg::BLOCKS, cfg::BANDWIDTH * cfg::CHANNELS);
+	ColumnsSnapshot averfade_snap(ensemble.sliding_averfade_spectrum.data(), &(ensemble.sliding_averfade_spectrum_lock), 1, cfg::BANDWIDTH);
+	ColumnsSnapshot synth_sg_snap(ensemble.spectrogram.data(), ensemble.spectrogram_locks.get(), cfg::WIDTH, cfg::BANDWIDTH * cfg::CHANNELS);
+	ColumnsSnapshot eventogram_snap(ensemble.eventogram.data(), ensemble.eventogram_locks.get(), cfg::WIDTH, n_players * 3);
+
+	unique_ptr<LatencyProbe> probe;
+	if (latency_test) {
+		probe.reset(new LatencyProbe());
+		ctrl.probe = probe.get();
 	}
 
-	printf("✅\nKeys (at ReSonat window, not here):\nQ - quit, E - toggle echoes output, S - toggle synth output, R - toggle render\n");
+	// Real-time only: offline render has no deadline, and keeps all work for deterministic results
+	Governor governor;
+	ctrl.governor = &governor;
+	ensemble.governor = &governor;
+
+	echoes.start_tending();
+
+	streams.start(&ctrl, duplex);
+
+	echoes.start_checkpoints();
+
+	printf("✅ (%s, latency in/out %.1f/%.1f ms) renderer… ", duplex ? "duplex" : "in & out", 1e3 * streams.input_latency, 1e3 * streams.output_latency);
 	fflush(stdout);
 
-	auto framebuf = cv::Mat(2 + cfg::BLOCKSIZE + n_players, cfg::WIDTH, CV_8UC4);
-	uint32_t* fbdata_ptr;
+	Pool render_pool(cfg::RENDER_THREADS);
+	Renderer renderer(&echoes_sg_snap, &averfade_snap, &synth_sg_snap, &eventogram_snap, n_players, &render_pool);
+
+	unique_ptr<Exporter> exporter;
+	if (!export_path.empty()) {
+		exporter.reset(new Exporter(export_format, export_path, renderer.framebuf.cols, renderer.framebuf.rows));
+		printf("✅ exporter of %dx%d %s at %d fps… ", renderer.framebuf.cols, renderer.framebuf.rows, (export_format == Exporter::PNG) ? "PNGs" : "RGBA", cfg::FRAMERATE);
+	}
+
+	printf("✅\nKeys (at ReSonat window, not here):\nQ - quit, E - toggle echoes output, S - toggle synth output, R - toggle render, T - report timings\n");
+	fflush(stdout);
 
 	bool quit = false;
 
 	bool do_render = true;
+	bool rendered = true; // at previous frame
 
-	auto t_imag_start = time_musec() - echoes.runtime;
-	echoes.runtime = 0;
+	auto t_imag_start = time_musec() - echoes.runtime.load();
 
-	while (!quit) {
-
-		if (do_render) {
-			
-			size_t src_offs;
-
-			// Echoes spectrogram
-			fbdata_ptr = (uint32_t*)framebuf.data;
-			auto echoes_sg_data = echoes.spectrogram.data();
-			for (size_t y = 0; y < cfg::BANDWIDTH; y++) {
-				for (size_t x = 0; x < (cfg::WIDTH - 0x100); x++) {
-					src_offs = offscaletab[y][x];
-					*fbdata_ptr = (((uint32_t)echoes_sg_data[src_offs]) << 8) + (((uint32_t)echoes_sg_data[src_offs + 1]) << 0x10); // green & red
-					fbdata_ptr++;
-				}
-				fbdata_ptr += 0x100;
-			}
-			int pos_blk = echoes.pos_blk_read * (cfg::WIDTH - 0x100) / cfg::BLOCKS;
-			cv::line(framebuf, cv::Point{pos_blk, 0}, cv::Point{pos_blk, cfg::BANDWIDTH - 1}, cv::Scalar{0xFF, 0, 0}); // playing head
-			pos_blk = echoes.pos_blk_write * (cfg::WIDTH - 0x100) / cfg::BLOCKS;
-			cv::line(framebuf, cv::Point{pos_blk, 0}, cv::Point{pos_blk, cfg::BANDWIDTH - 1}, cv::Scalar{0, 0, 0}); // recording head
-			// Echoes fading-average momentary spectrum
-			auto fbdata_row_ptr = ((uint32_t*)framebuf.data) + cfg::WIDTH - 0x100;
-			auto spg = ensemble.sliding_averfade_spectrum.data() +  cfg::BANDWIDTH - 1;
-			for (size_t y = 0; y < cfg::BANDWIDTH; y++) {
-				auto avener = (uint32_t)(*spg);
-				auto avener_color = 0x80 + (avener >> 1);
-				fbdata_ptr = fbdata_row_ptr;
-				for (int x = 0; x < avener; x++) {
-					*fbdata_ptr = avener_color; // blue
-					fbdata_ptr++;
-				}
-				memset(fbdata_ptr, 0, (0x100 - avener) << 2); // rest of the line is black
-				spg--;
-				fbdata_row_ptr += cfg::WIDTH;
-			}
+	auto t_drain = time_musec();
 
-			cv::line(framebuf, cv::Point{0, cfg::BANDWIDTH}, cv::Point{cfg::WIDTH - 1, cfg::BANDWIDTH}, cv::Scalar{0x80, 0, 0});
-
-			// Cannot use ensemble.pos_blk itself, because it can be updated by another thread in out_callback(),
-			// in the middle of the following 2 drawings
-			auto ensemble_pos_blk = ensemble.pos_blk;
-
-			// Eventogram
-			for (size_t x = 0; x < cfg::WIDTH; x++) {
-				auto ex = widthmodtab[x + ensemble_pos_blk];
-				fbdata_ptr = ((uint32_t*)framebuf.data) + (1 + cfg::BANDWIDTH) * cfg::WIDTH + x;
-				auto evg = ensemble.eventogram.data() + (ex * n_players * 3);
-				for (size_t y = 0; y < n_players; y++) {
-					*fbdata_ptr = ((uint32_t)(*evg)) + (((uint32_t)(*(evg + 1))) << 8) + (((uint32_t)(*(evg + 2))) << 0x10);
-					fbdata_ptr += cfg::WIDTH;
-					evg += 3;
-				}
-			}
+	while (!quit) {
 
-			cv::line(framebuf, cv::Point{0, (int)(1 + cfg::BANDWIDTH + n_players)}, cv::Point{cfg::WIDTH - 1, (int)(1 + cfg::BANDWIDTH + n_players)}, cv::Scalar{0, 0x80, 0});
-
-			// Synth spectrogram
-			for (size_t x = 0x100; x < cfg::WIDTH; x++) {
-				auto ex = widthmodtab[x + ensemble_pos_blk];
-				fbdata_ptr = ((uint32_t*)framebuf.data) + (2 + cfg::BANDWIDTH + n_players) * cfg::WIDTH + x - 0x100;
-				auto spg = ensemble.spectrogram.data() + ((ex * cfg::BANDWIDTH + cfg::BANDWIDTH - 1 ) * cfg::CHANNELS);
-				for (size_t y = 0; y < cfg::BANDWIDTH; y++) {
-					*fbdata_ptr = ((uint32_t)(*spg)) + (((uint32_t)(*(spg + 1))) << 0x10); // blue & red
-					spg -= cfg::CHANNELS;
-					fbdata_ptr += cfg::WIDTH;
-				}
+		bool rendering = do_render && (governor.get_level() < Governor::NO_RENDER);
+		if (rendering) {
+			if (!rendered) {
+				renderer.clear(); // snapshots would miss columns published during the pause
 			}
-			// Synth momentary spectrum
-			fbdata_row_ptr = ((uint32_t*)framebuf.data) + ((2 + cfg::BANDWIDTH + n_players) * cfg::WIDTH) + cfg::WIDTH - 0x100;
-			spg = ensemble.spectrogram.data() + ((widthmodtab[ensemble_pos_blk + cfg::WIDTH - 1] * cfg::BANDWIDTH + cfg::BANDWIDTH - 1 ) * cfg::CHANNELS);
-			for (size_t y = 0; y < cfg::BANDWIDTH; y++) {
-				auto avener = (((uint32_t)(*spg)) + ((uint32_t)(*(spg + 1)))) >> 1;
-				auto avener_color = (0x80 + (avener >> 1)) << 8; // green
-				fbdata_ptr = fbdata_row_ptr;
-				for (int x = 0; x < avener; x++) {
-					*fbdata_ptr = avener_color;
-					fbdata_ptr++;
-				}
-				memset(fbdata_ptr, 0, (0x100 - avener) << 2); // rest of the line is black
-				spg -= cfg::CHANNELS;
-				fbdata_row_ptr += cfg::WIDTH;
+			renderer.render(echoes.pos_blk_read.load(memory_order_acquire), echoes.pos_blk_write.load(memory_order_acquire), ensemble.pos_blk.load(memory_order_acquire));
+			cv::imshow("ReSonat", renderer.framebuf);
+			if (exporter) {
+				exporter->push(renderer.framebuf);
 			}
-
-			cv::imshow("ReSonat", framebuf);
 		}
+		rendered = rendering;
 
 		int key = cv::waitKey(int(1000 / cfg::FRAMERATE));
 		switch (key) {
@@ -199,40 +319,96 @@ int main() {
 				break;
 			case 'e':
 			case 'E':
-				ctrl.do_echoes_out = !ctrl.do_echoes_out;
+				ctrl.do_echoes_out.store(!ctrl.do_echoes_out.load());
 				break;
 			case 's':
 			case 'S':
-				ctrl.do_synth_out = !ctrl.do_synth_out;
+				ctrl.do_synth_out.store(!ctrl.do_synth_out.load());
+				break;
+			case 't':
+			case 'T':
+				printf("\n");
+				timings.report(stdout);
+				printf("Analysis jobs dropped: %lu\n", analyzer.n_dropped.load());
 				break;
 			case 'r':
 			case 'R':
 				do_render = !do_render;
 				if (!do_render) {
 					// Clear window
-					memset(framebuf.data, 0x40, ((2 + cfg::BLOCKSIZE + n_players) * cfg::WIDTH) << 2);
-					cv::imshow("ReSonat", framebuf);
+					renderer.clear();
+					cv::imshow("ReSonat", renderer.framebuf);
 				}
 				break;
 		}
 
-		echoes.runtime = time_musec() - t_imag_start;
-		double runtime_sec = 1e-6 * echoes.runtime;
+		if (time_musec() - t_drain >= 1000000) {
+			timings.drain();
+			t_drain = time_musec();
+		}
+		timings.report_flags(stderr);
+		ensemble.report_soundfonts(stdout);
+		governor.report(stdout);
+
+		echoes.runtime.store(time_musec() - t_imag_start);
+		double runtime_sec = 1e-6 * echoes.runtime.load();
 
-		auto echoes_toggle_symb = ctrl.do_echoes_out ? ON_SYMB : OFF_SYMB;
-		auto synth_toggle_symb = ctrl.do_synth_out ? ON_SYMB : OFF_SYMB;
+		auto echoes_toggle_symb = ctrl.do_echoes_out.load() ? ON_SYMB : OFF_SYMB;
+		auto synth_toggle_symb = ctrl.do_synth_out.load() ? ON_SYMB : OFF_SYMB;
+		auto pos_blk_read = echoes.pos_blk_read.load(memory_order_acquire);
+		auto pos_blk_write = echoes.pos_blk_write.load(memory_order_acquire);
 		auto render_toggle_symb = do_render ? ON_SYMB : OFF_SYMB;
-		printf("\rRuntime %.3f sec | %5.1f %% of lap %d | Echoes out %s | Synth out %s | Render %s | {W-R}=%lu       ", runtime_sec, 100.0 * echoes.pos_blk_read / cfg::BLOCKS, int(runtime_sec / cfg::DURATION), echoes_toggle_symb, synth_toggle_symb, render_toggle_symb, (cfg::BLOCKS + echoes.pos_blk_write - echoes.pos_blk_read) % cfg::BLOCKS);
+		printf("\rRuntime %.3f sec | %5.1f %% of lap %d | Echoes out %s | Synth out %s | Render %s | Governor %s | {W-R}=%lu | Drift %+.0f ppm, %lu dropped, %lu skipped | In/Out p99 %.0f/%.0f %% of block       ", runtime_sec, 100.0 * pos_blk_read / cfg::BLOCKS, int(runtime_sec / cfg::DURATION), echoes_toggle_symb, synth_toggle_symb, render_toggle_symb, governor.get_level_name(), (cfg::BLOCKS + pos_blk_write - pos_blk_read) % cfg::BLOCKS, ctrl.get_drift_ppm(), ctrl.n_dropped.load(), ctrl.n_skipped.load(), 1e5 * timings.interval[Timings::IN_CALLBACK].p99_musec / timings.deadline_ns, 1e5 * timings.interval[Timings::OUT_CALLBACK].p99_musec / timings.deadline_ns);
+		if (exporter) {
+			printf("| Export %lu frames, %lu dropped ", exporter->n_exported.load(), exporter->n_dropped.load());
+		}
+		if (echoes.tiers) {
+			printf("| Packed %.1f of %.1f MB, %lu missed ", 1e-6 * echoes.tiers->packed_bytes.load(), 1e-6 * cfg::BLOCKS * cfg::BLOCKMEMSIZE, echoes.tiers->n_misses.load());
+		}
+		if (probe) {
+			auto n_measured = probe->n_measured.load(memory_order_acquire);
+			printf("| Loopback ");
+			if (n_measured > 0) {
+				printf("%.1f ms, min %.1f ms, %lu measured, %lu missed ", 1e3 * probe->last_frames.load() / cfg::SAMPLERATE, 1e3 * probe->min_frames.load() / cfg::SAMPLERATE, n_measured, probe->n_missed.load());
+			} else {
+				printf("not detected yet, %lu missed ", probe->n_missed.load());
+			}
+		}
 		fflush(stdout);
 	}
 
 	cv::destroyAllWindows();
 
-	printf("\nStopping: streams… ");
+	printf("\nStopping: ");
+	if (exporter) {
+		printf("exporter… ");
+		fflush(stdout);
+		exporter->stop();
+		printf("✅ %lu frames, %lu dropped ", exporter->n_exported.load(), exporter->n_dropped.load());
+	}
+	printf("streams… ");
 	fflush(stdout);
 
 	streams.stop();
 
+	printf("✅ analyzer… ");
+	fflush(stdout);
+
+	analyzer.stop();
+
+	if (!record_path.empty()) {
+		printf("✅ MIDI log… ");
+		fflush(stdout);
+		midilog.stop();
+		printf("✅ %lu events, %lu dropped ", midilog.n_recorded.load(), midilog.n_dropped.load());
+	}
+
+	printf("✅ checkpoints… ");
+	fflush(stdout);
+
+	echoes.stop_checkpoints();
+	echoes.stop_tending();
+
 	printf("✅\nSaving: echoes… ");
 	fflush(stdout);
 
@@ -0,0 +1,362 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "runfile.hpp"
+
+const char* RUN_FILENAME = "echoes.run";
+const char RUN_MAGIC[8] = {'R', 'e', 'S', 'o', 'n', 'a', 't', 0};
+const uint32_t RUN_VERSION = 2;
+
+// Header of each version, by index: fields added by a version go after those of older ones, before crc,
+// so an older slot is read as the current Header up to its crc, with the rest zeroed
+struct HeaderLayout {
+	uint32_t header_size;
+	size_t crc_offset;
+};
+static const HeaderLayout HEADER_LAYOUTS[RUN_VERSION + 1] = {
+	{0, 0},
+	{136, 128}, // up to runtime
+	{uint32_t(sizeof(RunFile::Header)), offsetof(RunFile::Header, crc)}
+};
+
+// Raw dumps of versions before the container, with cfg parameters implied
+const char* LEGACY_COUNTERS_FILENAME = "counters.bin";
+const char* LEGACY_DATA_FILENAME = "data.bin";
+const char* LEGACY_SPECTROGRAM_FILENAME = "spectrogram.bin";
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+	static uint32_t table[0x100];
+	static bool table_ready = false;
+	if (!table_ready) {
+		for (uint32_t i = 0; i < 0x100; i++) {
+			uint32_t c = i;
+			for (size_t k = 0; k < 8; k++) {
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			}
+			table[i] = c;
+		}
+		table_ready = true;
+	}
+	uint32_t c = 0xFFFFFFFF;
+	for (size_t i = 0; i < size; i++) {
+		c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+	}
+	return c ^ 0xFFFFFFFF;
+}
+
+RunFile::RunFile() {
+	lay_out(this->layout, cfg_params());
+}
+
+RunFile::Params RunFile::cfg_params() {
+	return Params{uint32_t(cfg::CHANNELS), uint32_t(cfg::SAMPLERATE), uint32_t(cfg::BLOCKSIZE), uint32_t(cfg::PLANAR), uint64_t(cfg::BLOCKS), cfg::SPECTRUM_FLOOR_DB, cfg::SPECTRUM_RANGE_DB};
+}
+
+size_t RunFile::lay_out(Header& header, const Params& params) {
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RUN_MAGIC, sizeof(header.magic));
+	header.version = RUN_VERSION;
+	header.header_size = sizeof(Header);
+	header.params = params;
+	header.section_sizes[DATA] = params.blocks * params.blocksize * params.channels * sizeof(int16_t);
+	header.section_sizes[SPECTROGRAM] = params.blocks * (params.blocksize >> 1) * params.channels;
+	header.section_sizes[CHECKSUMS] = 2 * params.blocks * sizeof(uint32_t);
+	size_t offset = 2 * SLOT_SIZE;
+	for (size_t s = 0; s < SECTIONS_NUM; s++) {
+		header.section_offsets[s] = offset;
+		offset += (header.section_sizes[s] + SLOT_SIZE - 1) / SLOT_SIZE * SLOT_SIZE;
+	}
+	return offset;
+}
+
+const RunFile::Header* RunFile::current_slot(const MappedFile& file, bool& newer) {
+	const Header* current = NULL;
+	newer = false;
+	for (size_t i = 0; (i < 2) && (file.size >= 2 * SLOT_SIZE); i++) {
+		auto h = (const Header*)(file.ptr + i * SLOT_SIZE);
+		if (memcmp(h->magic, RUN_MAGIC, sizeof(h->magic)) != 0) {
+			continue;
+		}
+		if (h->version > RUN_VERSION) {
+			newer = true;
+			continue;
+		}
+		if ((h->version == 0) || (h->header_size != HEADER_LAYOUTS[h->version].header_size)) {
+			continue;
+		}
+		auto crc_offset = HEADER_LAYOUTS[h->version].crc_offset;
+		if (crc32((const uint8_t*)h, crc_offset) != *(const uint32_t*)((const uint8_t*)h + crc_offset)) {
+			continue; // torn or damaged
+		}
+		auto& p = h->params;
+		if ((p.channels == 0) || (p.channels > 0x100) || (p.samplerate == 0) || (p.blocksize < 2) || ((p.blocksize & (p.blocksize - 1)) != 0) || (p.blocks == 0) || (p.blocks > (uint64_t(1) << 40) / p.blocksize)) {
+			continue;
+		}
+		Header expected;
+		auto size = lay_out(expected, p);
+		if ((memcmp(expected.section_offsets, h->section_offsets, sizeof(h->section_offsets)) != 0) || (memcmp(expected.section_sizes, h->section_sizes, sizeof(h->section_sizes)) != 0) || (file.size < size)) {
+			continue;
+		}
+		if ((current == NULL) || (h->sequence > current->sequence)) {
+			current = h;
+		}
+	}
+	return current;
+}
+
+RunFile::Header RunFile::read_slot(const Header* slot) {
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(&header, slot, HEADER_LAYOUTS[slot->version].crc_offset);
+	return header;
+}
+
+void RunFile::map_sections() {
+	this->data = (int16_t*)(this->file.ptr + this->layout.section_offsets[DATA]);
+	this->spectrogram = this->file.ptr + this->layout.section_offsets[SPECTROGRAM];
+	this->checksums = (uint32_t*)(this->file.ptr + this->layout.section_offsets[CHECKSUMS]);
+}
+
+int RunFile::open_anonymous() {
+	auto size = lay_out(this->layout, cfg_params());
+	if (this->file.open_anonymous(size) != 0) {
+		return -1;
+	}
+	this->map_sections();
+	this->sequence = 0;
+	this->pos_blk_read = 0;
+	this->pos_blk_write = 0;
+	this->runtime = 0;
+	return 0;
+}
+
+int RunFile::create(const string& path, bool shared) {
+	auto size = lay_out(this->layout, cfg_params());
+	if (shared) {
+		unlink(path.c_str()); // stale one would not be zeroed
+		if (this->file.open(path, size, true) < 0) {
+			return -1;
+		}
+	} else if (this->file.open_anonymous(size) != 0) {
+		return -1;
+	}
+	this->map_sections();
+	this->sequence = 0;
+	return 0;
+}
+
+// Of sample of frame's channel, from the start of samples
+static inline size_t sample_offset(size_t frame, size_t channel, size_t channels, size_t blocksize, bool planar) {
+	if (planar) {
+		return (frame - frame % blocksize) * channels + channel * blocksize + frame % blocksize;
+	}
+	return frame * channels + channel;
+}
+
+void RunFile::convert(const uint8_t* src, const Header& src_header) {
+	auto& sp = src_header.params;
+	auto src_data = (const int16_t*)(src + src_header.section_offsets[DATA]);
+	size_t src_frames = sp.blocks * sp.blocksize;
+	size_t src_pos = (src_header.pos_blk_read % sp.blocks) * sp.blocksize;
+	size_t frames = cfg::BLOCKS * cfg::BLOCKSIZE;
+	double ratio = double(sp.samplerate) / cfg::SAMPLERATE; // source frames per frame
+
+	this->pos_blk_read = size_t(src_pos / ratio) / cfg::BLOCKSIZE % cfg::BLOCKS;
+	this->runtime = src_header.runtime;
+	size_t pos = this->pos_blk_read * cfg::BLOCKSIZE;
+
+	// Loop is continuous, so the sample after the last one is the 1st
+	for (size_t j = 0; j < frames; j++) {
+		auto dst_frame = (pos + j) % frames;
+		double t = j * ratio;
+		if (t >= src_frames) {
+			for (size_t c = 0; c < cfg::CHANNELS; c++) {
+				this->data[sample_offset(dst_frame, c, cfg::CHANNELS, cfg::BLOCKSIZE, cfg::PLANAR != 0)] = 0;
+			}
+			continue;
+		}
+		size_t i = size_t(t);
+		double frac = t - i;
+		auto a_frame = (src_pos + i) % src_frames;
+		auto b_frame = (src_pos + i + 1) % src_frames;
+		for (size_t c = 0; c < cfg::CHANNELS; c++) {
+			auto ac = src_data[sample_offset(a_frame, c % sp.channels, sp.channels, sp.blocksize, sp.planar != 0)];
+			auto bc = src_data[sample_offset(b_frame, c % sp.channels, sp.channels, sp.blocksize, sp.planar != 0)];
+			this->data[sample_offset(dst_frame, c, cfg::CHANNELS, cfg::BLOCKSIZE, cfg::PLANAR != 0)] = int16_t(lround(ac + (bc - ac) * frac));
+		}
+	}
+
+	for (size_t i = 0; i < cfg::BLOCKS; i++) {
+		this->update_checksum(DATA, i);
+	}
+}
+
+int RunFile::open(const string& dirpath, bool shared) {
+	auto path = dirpath + "/" + string(RUN_FILENAME);
+	auto tmp_path = path + ".tmp";
+	auto size = lay_out(this->layout, cfg_params());
+	int result;
+
+	MappedFile src;
+	bool newer = false;
+	const Header* src_slot = (src.open_readonly(path) == 0) ? current_slot(src, newer) : NULL;
+	auto params = cfg_params();
+	if ((src_slot == NULL) && newer) {
+		fprintf(stderr, "\"%s\" is of newer version, left as is.\n", path.c_str());
+		return -1;
+	}
+	if ((src_slot != NULL) && (src_slot->version == RUN_VERSION) && (memcmp(&(src_slot->params), &params, sizeof(params)) == 0) && (src.size == size)) {
+		auto header = *src_slot;
+		src.close();
+		if (this->file.open(path, size, shared) != 0) {
+			return -1;
+		}
+		this->map_sections();
+		this->sequence = header.sequence;
+		this->pos_blk_read = header.pos_blk_read % cfg::BLOCKS;
+		this->pos_blk_write = header.pos_blk_write % cfg::BLOCKS;
+		this->runtime = header.runtime;
+		return 0;
+	} else if (src_slot != NULL) {
+		auto header = read_slot(src_slot); // of older version, or with other parameters
+		if (this->create(tmp_path, shared) != 0) {
+			return -1;
+		}
+		this->convert(src.ptr, header);
+		result = 1;
+	} else {
+		if (src.ptr != NULL) {
+			if (!shared) {
+				fprintf(stderr, "\"%s\" is not recognized, left as is.\n", path.c_str());
+				return -1;
+			}
+			fprintf(stderr, "\"%s\" is not recognized, moved aside.\n", path.c_str());
+			rename(path.c_str(), (path + ".bad").c_str());
+		}
+		src.close();
+		// Raw dumps of older versions
+		Header legacy_header;
+		lay_out(legacy_header, params);
+		legacy_header.params.planar = 0; // they were interleaved only
+		ifstream ifs(dirpath + "/" + string(LEGACY_COUNTERS_FILENAME), ios::binary | ios::in);
+		ifs.read((char*)&(legacy_header.pos_blk_read), sizeof(legacy_header.pos_blk_read));
+		ifs.read((char*)&(legacy_header.runtime), sizeof(legacy_header.runtime));
+		bool counters_read = ifs.good();
+		ifs.close();
+		if (counters_read && (src.open_readonly(dirpath + "/" + string(LEGACY_DATA_FILENAME)) == 0) && (src.size == legacy_header.section_sizes[DATA])) {
+			legacy_header.section_offsets[DATA] = 0;
+			if (this->create(tmp_path, shared) != 0) {
+				return -1;
+			}
+			this->convert(src.ptr, legacy_header);
+			result = 1;
+		} else {
+			if (this->create(tmp_path, shared) != 0) {
+				return -1;
+			}
+			this->pos_blk_read = 0;
+			this->runtime = 0;
+			for (size_t i = 0; i < cfg::BLOCKS; i++) {
+				this->update_checksum(DATA, i);
+				this->update_checksum(SPECTROGRAM, i);
+			}
+			result = 2;
+		}
+		src.close();
+	}
+
+	this->sync(DATA, 0, cfg::BLOCKS);
+	this->sync(CHECKSUMS, 0, cfg::BLOCKS);
+	if ((this->commit(this->pos_blk_read, this->pos_blk_read, this->runtime) != 0) || (shared && (rename(tmp_path.c_str(), path.c_str()) != 0))) {
+		return -1;
+	}
+	if (shared && (result == 1)) {
+		unlink((dirpath + "/" + string(LEGACY_COUNTERS_FILENAME)).c_str());
+		unlink((dirpath + "/" + string(LEGACY_DATA_FILENAME)).c_str());
+		unlink((dirpath + "/" + string(LEGACY_SPECTROGRAM_FILENAME)).c_str());
+	}
+	return result;
+}
+
+uint32_t RunFile::checksum(Section section, size_t pos_blk) const {
+	if (section == DATA) {
+		return crc32((const uint8_t*)(this->data + pos_blk * cfg::BLOCKSIZE * cfg::CHANNELS), cfg::BLOCKMEMSIZE);
+	} else {
+		return crc32(this->spectrogram + pos_blk * cfg::BANDWIDTH * cfg::CHANNELS, cfg::BANDWIDTH * cfg::CHANNELS);
+	}
+}
+
+bool RunFile::verify(Section section, size_t pos_blk) const {
+	return this->checksums[((section == DATA) ? 0 : cfg::BLOCKS) + pos_blk] == this->checksum(section, pos_blk);
+}
+
+void RunFile::update_checksum(Section section, size_t pos_blk) {
+	this->checksums[((section == DATA) ? 0 : cfg::BLOCKS) + pos_blk] = this->checksum(section, pos_blk);
+}
+
+void RunFile::sync(Section section, size_t pos_blk, size_t n_blks) {
+	auto offset = this->layout.section_offsets[section];
+	if (section == CHECKSUMS) {
+		this->file.sync(offset, this->layout.section_sizes[section]);
+		return;
+	}
+	auto block_size = this->layout.section_sizes[section] / cfg::BLOCKS;
+	auto n_blks_1st = min(n_blks, cfg::BLOCKS - pos_blk);
+	this->file.sync(offset + pos_blk * block_size, n_blks_1st * block_size);
+	this->file.sync(offset, (n_blks - n_blks_1st) * block_size);
+}
+
+void RunFile::release(Section section, size_t pos_blk, size_t n_blks) {
+	auto offset = this->layout.section_offsets[section];
+	auto block_size = this->layout.section_sizes[section] / cfg::BLOCKS;
+	auto n_blks_1st = min(n_blks, cfg::BLOCKS - pos_blk);
+	this->file.release(offset + pos_blk * block_size, n_blks_1st * block_size);
+	this->file.release(offset, (n_blks - n_blks_1st) * block_size);
+}
+
+int RunFile::commit(size_t pos_blk_read, size_t pos_blk_write, int64_t runtime) {
+	this->sequence++;
+	Header header = this->layout;
+	header.sequence = this->sequence;
+	header.pos_blk_read = pos_blk_read;
+	header.runtime = runtime;
+	header.pos_blk_write = pos_blk_write;
+	header.crc = crc32((const uint8_t*)&header, offsetof(Header, crc));
+	auto slot_offset = (this->sequence & 1) * SLOT_SIZE;
+	memset(this->file.ptr + slot_offset, 0, SLOT_SIZE);
+	memcpy(this->file.ptr + slot_offset, &header, sizeof(header));
+	this->pos_blk_read = pos_blk_read;
+	this->pos_blk_write = pos_blk_write;
+	this->runtime = runtime;
+	return this->file.sync(slot_offset, SLOT_SIZE);
+}
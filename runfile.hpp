@@ -0,0 +1,96 @@
+#ifndef _RUNFILE_HPP
+#define _RUNFILE_HPP
+
+#include <string>
+
+#include "mapped.hpp"
+
+using namespace std;
+
+// Self-describing container of echoes state, one file mapped into memory (native byte order):
+// 2 header slots of a page each, committed alternately, the valid one with larger sequence number is current;
+// then page-aligned sections of samples, spectrogram, and CRC-32 per block of both.
+// Only the header is committed atomically. Sections are mapped shared and written in place, so the kernel may write their pages
+// to disk at any time, before the next commit too: after a crash, blocks from the committed writing head on may be newer than
+// the commit, or torn, and are to be checked by their checksums, but kept (torn samples are still sound of the loop, unlike silence);
+// blocks before it are as synced by the commit, so failing ones are damaged. Blocks are not journaled: it would double writes of samples.
+// State saved with other parameters, or by older version, is converted on open: layout is changed, channels are repeated or dropped, samplerate is
+// linearly interpolated, and the loop is cut or padded with silence after reading head; spectrogram is left to recompute.
+class RunFile {
+
+public:
+
+	enum Section {
+		DATA,
+		SPECTROGRAM,
+		CHECKSUMS,
+		SECTIONS_NUM
+	};
+
+	struct Params {
+		uint32_t channels;
+		uint32_t samplerate;
+		uint32_t blocksize;
+		uint32_t planar; // cfg::PLANAR, layout of blocks & slices
+		uint64_t blocks;
+		double spectrum_floor_db;
+		double spectrum_range_db;
+	};
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t header_size;
+		uint64_t sequence; // of commit
+		Params params;
+		uint64_t section_offsets[SECTIONS_NUM];
+		uint64_t section_sizes[SECTIONS_NUM];
+		uint64_t pos_blk_read;
+		int64_t runtime;
+		uint64_t pos_blk_write; // blocks before it are synced with their checksums, those from it on may be not (version 2)
+		uint32_t crc; // of all the above
+	};
+
+	static const size_t SLOT_SIZE = 0x1000;
+
+private:
+
+	MappedFile file;
+	Header layout; // for cfg parameters
+	uint64_t sequence = 0;
+
+	static Params cfg_params();
+	static size_t lay_out(Header& header, const Params& params); // returns size of file
+	static const Header* current_slot(const MappedFile& file, bool& newer); // of this or older version; newer tells if there is one of newer version
+	static Header read_slot(const Header* slot); // of any version current_slot() accepts
+	void map_sections();
+	int create(const string& path, bool shared);
+	void convert(const uint8_t* src, const Header& src_header);
+
+public:
+
+	int16_t* data = NULL;
+	uint8_t* spectrogram = NULL;
+	uint32_t* checksums = NULL; // of data blocks, then of spectrogram slices
+	size_t pos_blk_read = 0; // as of the last commit
+	size_t pos_blk_write = 0;
+	int64_t runtime = 0;
+
+	RunFile();
+
+	int open_anonymous();
+	// Returns 0 if loaded as is, 1 if converted (from other parameters, or from raw dumps of older versions), 2 if created empty, -1 on failure
+	int open(const string& dirpath, bool shared);
+
+	uint32_t checksum(Section section, size_t pos_blk) const;
+	bool verify(Section section, size_t pos_blk) const;
+	void update_checksum(Section section, size_t pos_blk);
+	void sync(Section section, size_t pos_blk, size_t n_blks); // wraps around the loop; for checksums, of the blocks of both
+	void release(Section section, size_t pos_blk, size_t n_blks); // of synced blocks, wraps around the loop too
+	int commit(size_t pos_blk_read, size_t pos_blk_write, int64_t runtime); // of header atomically, after the blocks before pos_blk_write are synced
+
+};
+
+uint32_t crc32(const uint8_t* data, size_t size);
+
+#endif
\ No newline at end of file
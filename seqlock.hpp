@@ -0,0 +1,138 @@
+#ifndef _SEQLOCK_HPP
+#define _SEQLOCK_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// Sequence counter guarding a column of bytes, written by the single writer thread and copied by any reader thread.
+// Writer never waits, it only bumps the counter to odd before and to even after the write;
+// reader retries its copy when the counter was odd or changed during it.
+class SeqLock {
+
+	atomic<uint32_t> seq;
+
+public:
+
+	SeqLock() {
+		this->seq.store(0);
+	}
+
+	// Writer side
+
+	inline void write_begin() {
+		this->seq.store(this->seq.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release); // orders the odd counter before the data
+	}
+
+	inline void write_end() {
+		this->seq.store(this->seq.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+
+	// Reader side
+
+	inline uint32_t read_begin() const {
+		return this->seq.load(memory_order_acquire);
+	}
+
+	inline bool read_retry(uint32_t s) const {
+		atomic_thread_fence(memory_order_acquire); // orders the data before the counter
+		return ((s & 1) != 0) || (this->seq.load(memory_order_relaxed) != s);
+	}
+
+	// Copies size bytes from src guarded by this lock, returns counter of the copy, or odd one if failed to get it consistent
+	uint32_t read(const uint8_t* src, uint8_t* dst, size_t size, size_t attempts = 4) const {
+		for (size_t i = 0; i < attempts; i++) {
+			auto s = this->read_begin();
+			if ((s & 1) == 0) {
+				memcpy(dst, src, size);
+				if (!this->read_retry(s)) {
+					return s;
+				}
+			}
+		}
+		return 1;
+	}
+
+};
+
+// Reader-side copy of columns guarded by seqlocks each, updated by copying only the columns published since previous update.
+// Writer publishing columns in ring order, each by lag at most behind its head, lets update() poll only those from previous window on.
+// Is to be constructed before the writer starts.
+class ColumnsSnapshot {
+
+	const uint8_t* src;
+	const SeqLock* locks;
+	size_t column_size;
+	vector<uint32_t> seen; // counters of columns in the copy
+	vector<uint8_t> column; // scratch, so that torn column does not get into the copy
+	size_t cursor; // first column to poll by next update(head, lag)
+	bool cursor_valid = false;
+
+	// Copies changed ones of n_columns from begin on, circularly; returns offset of the first torn one from begin, n_columns if none
+	size_t poll(size_t begin, size_t n_columns) {
+		size_t n_consistent = n_columns;
+		for (size_t j = 0; j < n_columns; j++) {
+			auto i = (begin + j) % this->seen.size();
+			auto& lock = this->locks[i];
+			if (lock.read_begin() != this->seen[i]) {
+				auto s = lock.read(this->src + i * this->column_size, this->column.data(), this->column_size);
+				if ((s & 1) == 0) {
+					memcpy(this->data.data() + i * this->column_size, this->column.data(), this->column_size);
+					this->seen[i] = s;
+					this->updated.push_back(i);
+				} else {
+					n_consistent = min(n_consistent, j);
+				}
+			}
+		}
+		return n_consistent;
+	}
+
+public:
+
+	vector<uint8_t> data;
+	vector<size_t> updated; // indices of columns copied by the last update()
+
+	ColumnsSnapshot(const uint8_t* src, const SeqLock* locks, size_t n_columns, size_t column_size) {
+		this->src = src;
+		this->locks = locks;
+		this->column_size = column_size;
+		this->seen = vector<uint32_t>(n_columns, 0);
+		this->column = vector<uint8_t>(column_size);
+		this->data = vector<uint8_t>(n_columns * column_size);
+		this->updated.reserve(n_columns);
+		this->cursor = 0;
+		memcpy(this->data.data(), src, this->data.size()); // initial content, e.g. loaded echoes, is not published
+	}
+
+	// Polls all columns, e.g. after a pause, as the writer may have gone round since; returns number of columns copied,
+	// torn ones are left for the next update
+	size_t update() {
+		this->updated.clear();
+		this->poll(0, this->seen.size());
+		this->cursor_valid = false;
+		return this->updated.size();
+	}
+
+	// Polls columns from the previous window (or torn ones) to head, the writer's next column; all of them at first
+	size_t update(size_t head, size_t lag) {
+		auto n = this->seen.size();
+		if (lag >= n) {
+			return this->update();
+		}
+		this->updated.clear();
+		auto begin = this->cursor_valid ? this->cursor : head;
+		auto n_columns = this->cursor_valid ? ((head + n - begin) % n) : n;
+		auto n_consistent = this->poll(begin, n_columns);
+		this->cursor = (begin + min(n_consistent, (n_columns > lag) ? (n_columns - lag) : 0)) % n;
+		this->cursor_valid = true;
+		return this->updated.size();
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,230 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+
+#include "mapped.hpp"
+#include "sfloader.hpp"
+
+// Files being installed, by path, for callbacks of the loader, which get no context
+static mutex mapped_files_mutex;
+static map<string, const MappedFile*> mapped_files;
+
+// Handle of file opened by loader: either mapped one, or one on disk
+struct SoundfontFile {
+	FILE* file;
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+};
+
+static void* sf_open(const char* path) {
+	{
+		lock_guard<mutex> lock(mapped_files_mutex);
+		auto it = mapped_files.find(path);
+		if (it != mapped_files.end()) {
+			return new SoundfontFile{NULL, it->second->ptr, it->second->size, 0};
+		}
+	}
+	auto file = fopen(path, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+	return new SoundfontFile{file, NULL, 0, 0};
+}
+
+static int sf_read(void* buf, fluid_long_long_t count, void* handle) {
+	auto sff = (SoundfontFile*)handle;
+	if (count < 0) {
+		return FLUID_FAILED;
+	}
+	if (sff->file != NULL) {
+		return (fread(buf, 1, count, sff->file) == size_t(count)) ? FLUID_OK : FLUID_FAILED;
+	}
+	if (size_t(count) > sff->size - sff->pos) {
+		return FLUID_FAILED;
+	}
+	memcpy(buf, sff->data + sff->pos, count);
+	sff->pos += count;
+	return FLUID_OK;
+}
+
+static int sf_seek(void* handle, fluid_long_long_t offset, int origin) {
+	auto sff = (SoundfontFile*)handle;
+	if (sff->file != NULL) {
+		return (fseeko(sff->file, offset, origin) == 0) ? FLUID_OK : FLUID_FAILED;
+	}
+	fluid_long_long_t base = (origin == SEEK_SET) ? 0 : ((origin == SEEK_CUR) ? sff->pos : sff->size);
+	if ((base + offset < 0) || (size_t(base + offset) > sff->size)) {
+		return FLUID_FAILED;
+	}
+	sff->pos = base + offset;
+	return FLUID_OK;
+}
+
+static fluid_long_long_t sf_tell(void* handle) {
+	auto sff = (SoundfontFile*)handle;
+	if (sff->file != NULL) {
+		return ftello(sff->file);
+	}
+	return sff->pos;
+}
+
+static int sf_close(void* handle) {
+	auto sff = (SoundfontFile*)handle;
+	if (sff->file != NULL) {
+		fclose(sff->file);
+	}
+	delete sff;
+	return FLUID_OK;
+}
+
+// Reads a byte per page, except of sample data (LIST sdta chunk) of RIFF, as synth loads only samples of selected presets,
+// which are paged in on demand then
+static void page_in(const MappedFile& mapped) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	volatile uint8_t sink = 0;
+	bool riff = (mapped.size >= 12) && (memcmp(mapped.ptr, "RIFF", 4) == 0);
+	size_t offset = riff ? 12 : 0;
+	while (offset < mapped.size) {
+		size_t end = mapped.size;
+		bool skip = false;
+		if (riff) {
+			if (offset + 12 > mapped.size) {
+				break;
+			}
+			uint32_t chunk_size;
+			memcpy(&chunk_size, mapped.ptr + offset + 4, 4);
+			end = min(mapped.size, offset + 8 + chunk_size);
+			skip = (memcmp(mapped.ptr + offset, "LIST", 4) == 0) && (memcmp(mapped.ptr + offset + 8, "sdta", 4) == 0);
+		}
+		if (!skip) {
+			for (size_t o = offset; o < end; o += page) {
+				sink ^= mapped.ptr[o];
+			}
+		}
+		offset = end + (end & 1); // chunks are word-aligned
+	}
+}
+
+// Resident set size of process
+static size_t rss() {
+	size_t size = 0, resident = 0;
+	auto f = fopen("/proc/self/statm", "r");
+	if (f != NULL) {
+		if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+			resident = 0;
+		}
+		fclose(f);
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static int64_t now_ns() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SoundfontLoader::SoundfontLoader(fluid_synth_t* synth, fluid_settings_t* settings) {
+	auto loader = new_fluid_defsfloader(settings);
+	fluid_sfloader_set_callbacks(loader, sf_open, sf_read, sf_seek, sf_tell, sf_close);
+	fluid_synth_add_sfloader(synth, loader); // tried before the default one, synth owns it
+	this->t_start = now_ns();
+}
+
+void SoundfontLoader::start(const vector<string>& paths, function<int(size_t, const string&)> install) {
+	this->t_start = now_ns();
+	this->loads = vector<Load>(paths.size());
+	this->done = unique_ptr<atomic<bool>[]>(new atomic<bool>[paths.size()]);
+	this->reported = vector<bool>(paths.size(), false);
+	for (size_t i = 0; i < paths.size(); i++) {
+		this->loads[i].path = paths[i];
+		this->done[i].store(false);
+	}
+	for (size_t i = 0; i < paths.size(); i++) {
+		this->threads.push_back(thread(&SoundfontLoader::load, this, i, install));
+	}
+}
+
+void SoundfontLoader::load(size_t i, const function<int(size_t, const string&)>& install) {
+	auto& ld = this->loads[i];
+
+	// Page in, so that install copies from memory instead of waiting for disk
+	MappedFile mapped;
+	if (mapped.open_readonly(ld.path) == 0) {
+		page_in(mapped);
+		ld.size = mapped.size;
+	}
+	ld.t_read_end = 1e-9 * (now_ns() - this->t_start);
+
+	{
+		lock_guard<mutex> install_lock(this->install_mutex);
+		ld.t_install_begin = 1e-9 * (now_ns() - this->t_start);
+		if (ld.size > 0) {
+			lock_guard<mutex> lock(mapped_files_mutex);
+			mapped_files[ld.path] = &mapped;
+		}
+		ld.sfid = install(i, ld.path);
+		{
+			lock_guard<mutex> lock(mapped_files_mutex);
+			mapped_files.erase(ld.path);
+		}
+		mapped.close();
+		ld.t_install_end = 1e-9 * (now_ns() - this->t_start);
+		ld.rss = rss();
+	}
+
+	this->done[i].store(true, memory_order_release);
+}
+
+void SoundfontLoader::wait() {
+	for (auto& th : this->threads) {
+		if (th.joinable()) {
+			th.join();
+		}
+	}
+}
+
+void SoundfontLoader::report(FILE* f) {
+	for (size_t i = 0; i < this->loads.size(); i++) {
+		if (this->reported[i] || !this->done[i].load(memory_order_acquire)) {
+			continue;
+		}
+		auto& ld = this->loads[i];
+		if (ld.sfid == FLUID_FAILED) {
+			fprintf(f, "\nSoundfont %s failed to load, at %.3f s\n", ld.path.c_str(), ld.t_install_end);
+		} else {
+			fprintf(f, "\nSoundfont %s: %.1f MB mapped by %.3f s, installed from %.3f s to %.3f s, RSS %.1f MB\n", ld.path.c_str(), 1e-6 * ld.size, ld.t_read_end, ld.t_install_begin, ld.t_install_end, 1e-6 * ld.rss);
+		}
+		this->reported[i] = true;
+	}
+}
+
+SoundfontLoader::~SoundfontLoader() {
+	this->wait();
+}
@@ -0,0 +1,62 @@
+#ifndef _SFLOADER_HPP
+#define _SFLOADER_HPP
+
+#include <fluidsynth.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Loads soundfonts in parallel, by thread per file, while sound is already running.
+// Each thread maps its file and pages it in (but sample data), so the slow part is done off the synth's lock,
+// then installs it by callback (serialized), which has synth load it from that memory through the loader added to synth.
+// Files not being installed are read from disk by the same loader, e.g. samples loaded by synth later.
+class SoundfontLoader {
+
+public:
+
+	// Timeline of load, in seconds since start()
+	struct Load {
+		string path;
+		size_t size = 0; // mapped, 0 if file failed to
+		int sfid = FLUID_FAILED;
+		double t_read_end = 0.0;
+		double t_install_begin = 0.0; // after waiting for other installs
+		double t_install_end = 0.0;
+		size_t rss = 0; // of process, after install
+	};
+
+private:
+
+	int64_t t_start;
+	vector<Load> loads;
+	unique_ptr<atomic<bool>[]> done; // load is final, written by its thread
+	vector<bool> reported; // by report() only
+	vector<thread> threads;
+	mutex install_mutex;
+
+	void load(size_t i, const function<int(size_t, const string&)>& install);
+
+public:
+
+	// Adds memory-aware loader to synth, before any soundfont is loaded to it
+	SoundfontLoader(fluid_synth_t* synth, fluid_settings_t* settings);
+
+	// Install callback gets index of soundfont and its path, loads it to synth, and returns sfid
+	void start(const vector<string>& paths, function<int(size_t, const string&)> install);
+	void wait(); // until all are installed or failed
+
+	void report(FILE* f); // timeline of loads finished since previous call
+
+	~SoundfontLoader();
+
+};
+
+#endif
\ No newline at end of file
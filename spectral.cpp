@@ -0,0 +1,134 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+
+#include "config.hpp"
+#include "fastpath.hpp"
+#include "kernels.hpp"
+#include "spectral.hpp"
+
+Spectral::Spectral() {
+	this->half = cfg::BLOCKSIZE >> 1;
+
+	size_t bits = 0;
+	while ((size_t(1) << bits) < this->half) {
+		bits++;
+	}
+	this->bitrev = vector<uint32_t>(this->half);
+	for (size_t i = 0; i < this->half; i++) {
+		uint32_t r = 0;
+		for (size_t b = 0; b < bits; b++) {
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		this->bitrev[i] = r;
+	}
+
+	// For stage of span m (half-size of butterfly group), twiddles are tw[half / (2m) * j], j < m
+	this->tw_re = vector<float>(this->half >> 1);
+	this->tw_im = vector<float>(this->half >> 1);
+	for (size_t j = 0; j < (this->half >> 1); j++) {
+		double phi = -2.0 * M_PI * j / this->half;
+		this->tw_re[j] = cos(phi);
+		this->tw_im[j] = sin(phi);
+	}
+
+	this->split_re = vector<float>(this->half + 1);
+	this->split_im = vector<float>(this->half + 1);
+	for (size_t k = 0; k <= this->half; k++) {
+		double phi = -2.0 * M_PI * k / cfg::BLOCKSIZE;
+		this->split_re[k] = cos(phi);
+		this->split_im[k] = sin(phi);
+	}
+
+	this->z_re = vector<float>(this->half);
+	this->z_im = vector<float>(this->half);
+	this->power = vector<float>(cfg::BANDWIDTH);
+
+	this->analyze_fn = select_fastpath<Analysis>();
+}
+
+template<size_t HALF>
+void Spectral::fft() {
+	const size_t half = (HALF != 0) ? HALF : this->half;
+	auto re = this->z_re.data();
+	auto im = this->z_im.data();
+	for (size_t m = 1; m < half; m <<= 1) {
+		size_t tw_step = half / (m << 1);
+		for (size_t k = 0; k < half; k += (m << 1)) {
+			for (size_t j = 0; j < m; j++) {
+				float wr = this->tw_re[j * tw_step];
+				float wi = this->tw_im[j * tw_step];
+				size_t a = k + j;
+				size_t b = a + m;
+				float tr = re[b] * wr - im[b] * wi;
+				float ti = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+template<size_t BS, size_t CH, bool PL>
+void Spectral::Analysis::run(Spectral& spectral, const int16_t* block, uint8_t* slice) {
+	const size_t half = fast_blocksize<BS>() >> 1;
+	const size_t channels = fast_channels<CH>();
+	const size_t stride = fast_stride<CH, PL>();
+	const float scale = 1.0f / 32768.0f;
+	auto re = spectral.z_re.data();
+	auto im = spectral.z_im.data();
+	for (size_t c = 0; c < channels; c++) {
+		// Even samples to re, odd ones to im, in bit-reversed order
+		auto src = block + c * fast_samples_lane<BS, PL>();
+		for (size_t i = 0; i < half; i++) {
+			auto r = spectral.bitrev[i];
+			re[r] = float(*src) * scale;
+			src += stride;
+			im[r] = float(*src) * scale;
+			src += stride;
+		}
+
+		spectral.fft<BS / 2>();
+
+		// X[k] = (Z[k] + Z*[h-k]) / 2 - i W^k (Z[k] - Z*[h-k]) / 2, h = half, W = exp(-2 pi i / BLOCKSIZE)
+		auto pw = spectral.power.data();
+		for (size_t k = 1; k < half; k++) {
+			float er = 0.5f * (re[k] + re[half - k]);
+			float ei = 0.5f * (im[k] - im[half - k]);
+			float or_ = 0.5f * (im[k] + im[half - k]);
+			float oi = -0.5f * (re[k] - re[half - k]);
+			float xr = er + spectral.split_re[k] * or_ - spectral.split_im[k] * oi;
+			float xi = ei + spectral.split_re[k] * oi + spectral.split_im[k] * or_;
+			*pw = xr * xr + xi * xi;
+			pw++;
+		}
+		float nyquist = re[0] - im[0];
+		*pw = nyquist * nyquist;
+
+		kernels::quantize(spectral.power.data(), slice + c * fast_bins_lane<BS, PL>(), half, stride);
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef _SPECTRAL_HPP
+#define _SPECTRAL_HPP
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// Energy spectral density of a block, by real FFT with plan precomputed for cfg::BLOCKSIZE (power of 2):
+// complex FFT of half size over even/odd samples as re/im, then split into real spectrum.
+// Not thread-safe, each user owns its instance. Specialized for common block sizes and channels counts, and by layout, see fastpath.hpp.
+class Spectral {
+
+	size_t half; // complex FFT size
+	vector<uint32_t> bitrev;
+	vector<float> tw_re; // twiddles of complex FFT
+	vector<float> tw_im;
+	vector<float> split_re; // twiddles of real split
+	vector<float> split_im;
+	vector<float> z_re; // to avoid allocations in callback
+	vector<float> z_im;
+	vector<float> power; // to avoid allocations in callback
+
+	struct Analysis {
+		template<size_t BS, size_t CH, bool PL>
+		static void run(Spectral& spectral, const int16_t* block, uint8_t* slice);
+	};
+
+	void (*analyze_fn)(Spectral& spectral, const int16_t* block, uint8_t* slice);
+
+	template<size_t HALF>
+	void fft();
+
+public:
+
+	Spectral();
+
+	// Quantizes bins 1…BANDWIDTH of all channels of block into spectrogram slice, both of cfg layout
+	inline void analyze(const int16_t* block, uint8_t* slice) {
+		this->analyze_fn(*this, block, slice);
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -1,12 +0,0 @@
-#ifndef _SPECTRUMSTATS_HPP
-#define _SPECTRUMSTATS_HPP
-
-#include <memory>
-
-struct SpectrumStats {
-    size_t argmax;
-    double max;
-    double mean;
-};
-
-#endif
\ No newline at end of file
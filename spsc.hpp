@@ -0,0 +1,99 @@
+#ifndef _SPSC_HPP
+#define _SPSC_HPP
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// Wait-free single-producer/single-consumer ring of preallocated slots.
+// Producer fills claim()-ed slot in place and publish()-es it, consumer reads peek()-ed slot in place and release()-s it,
+// so slots may be large (e.g. whole blocks) without copying through the ring.
+template<class T>
+class SpscRing {
+
+	vector<T> slots;
+	size_t mask;
+	char pad0[64];
+	atomic<size_t> head; // next slot to publish, written by producer only
+	char pad1[64];
+	atomic<size_t> tail; // next slot to release, written by consumer only
+	char pad2[64];
+
+public:
+
+	// Capacity is rounded up to power of 2
+	SpscRing(size_t capacity, const T& proto = T()) {
+		size_t n = 1;
+		while (n < capacity) {
+			n <<= 1;
+		}
+		this->slots = vector<T>(n, proto);
+		this->mask = n - 1;
+		this->head.store(0);
+		this->tail.store(0);
+	}
+
+	size_t capacity() const {
+		return this->mask + 1;
+	}
+
+	// Producer side
+
+	T* claim() {
+		auto h = this->head.load(memory_order_relaxed);
+		if (h - this->tail.load(memory_order_acquire) > this->mask) {
+			return NULL; // full
+		}
+		return &(this->slots[h & this->mask]);
+	}
+
+	void publish() {
+		this->head.store(this->head.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+
+	bool push(const T& item) {
+		auto slot = this->claim();
+		if (slot == NULL) {
+			return false;
+		}
+		*slot = item;
+		this->publish();
+		return true;
+	}
+
+	// Consumer side
+
+	T* peek() {
+		auto t = this->tail.load(memory_order_relaxed);
+		if (t == this->head.load(memory_order_acquire)) {
+			return NULL; // empty
+		}
+		return &(this->slots[t & this->mask]);
+	}
+
+	void release() {
+		this->tail.store(this->tail.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+
+	bool pop(T& item) {
+		auto slot = this->peek();
+		if (slot == NULL) {
+			return false;
+		}
+		item = *slot;
+		this->release();
+		return true;
+	}
+
+	// Either side, or other threads for monitoring
+
+	size_t size() const {
+		auto t = this->tail.load(memory_order_acquire); // first, so that head is not behind it
+		return this->head.load(memory_order_acquire) - t;
+	}
+
+};
+
+#endif
\ No newline at end of file
@@ -22,53 +22,58 @@ You should have received a copy of the GNU General Public License
 along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <cstring>
-#include <stdio.h>
-
 #include "config.hpp"
 #include "streams.hpp"
 
 int in_callback(const void *input, void *output, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData) {
 	auto ctrl = (Controller*)userData;
-	if (ctrl->sync_stage == -1) {
-		ctrl->echoes->sync_pos_blk_write();
-		ctrl->sync_stage = 0;
+	ctrl->process_input((int16_t*)input);
+	if ((statusFlags & paInputOverflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::INPUT_OVERFLOW); // reported by main thread, fprintf() is not real-time safe
 	}
-	if (ctrl->sync_stage == 0) {
-		ctrl->echoes->write((int16_t*)input); // updates slice of echoes spectrogram, inter alia
+	if ((statusFlags & paInputUnderflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::INPUT_UNDERFLOW);
 	}
-	if (statusFlags & paInputOverflow) {
-		fprintf(stderr, "InputOverflow\n");
+	return paContinue;
+}
+
+int out_callback(const void *input, void *output, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData) {
+	auto ctrl = (Controller *)userData;
+	ctrl->process_output((int16_t*)output);
+	if ((statusFlags & paOutputOverflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::OUTPUT_OVERFLOW);
+	}
+	if ((statusFlags & paOutputUnderflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::OUTPUT_UNDERFLOW);
 	}
-	if (statusFlags & paInputUnderflow) {
-		fprintf(stderr, "InputUnderflow\n");
+	if ((statusFlags & paPrimingOutput) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::PRIMING_OUTPUT);
 	}
 	return paContinue;
 }
 
-int out_callback(const void *input, void *output, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData) {
+int duplex_callback(const void *input, void *output, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData) {
 	auto ctrl = (Controller *)userData;
-	ctrl->ensemble->react_and_read(ctrl->echoes->spectrogram, ctrl->echoes->pos_blk_read, (int16_t*)output); // updates slice of synth spectrogram, inter alia
-	if (!ctrl->do_synth_out) {
-		memset(output, 0, cfg::BLOCKMEMSIZE);
-	}	
-	ctrl->echoes->read_add((int16_t*)output, !ctrl->do_echoes_out);
-	if (ctrl->sync_stage == -2) {
-		ctrl->sync_stage = -1;
+	ctrl->process_duplex((const int16_t*)input, (int16_t*)output);
+	if ((statusFlags & paInputOverflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::INPUT_OVERFLOW);
+	}
+	if ((statusFlags & paInputUnderflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::INPUT_UNDERFLOW);
 	}
-	if (statusFlags & paOutputOverflow) {
-		fprintf(stderr, "OutputOverflow\n");
+	if ((statusFlags & paOutputOverflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::OUTPUT_OVERFLOW);
 	}
-	if (statusFlags & paOutputUnderflow) {
-		fprintf(stderr, "OutputUnderflow\n");
+	if ((statusFlags & paOutputUnderflow) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::OUTPUT_UNDERFLOW);
 	}
-	if (statusFlags & paPrimingOutput) {
-		fprintf(stderr, "PrimingOutput\n");
+	if ((statusFlags & paPrimingOutput) && (ctrl->timings != NULL)) {
+		ctrl->timings->flag(Timings::PRIMING_OUTPUT);
 	}
 	return paContinue;
 }
 
-void Streams::start(Controller* ctrl) {
+void Streams::start(Controller* ctrl, bool duplex) {
 	// Suppress ALSA lib warnings (see https://github.com/PortAudio/portaudio/issues/463)
 	// From https://stackoverflow.com/questions/24778998/how-to-disable-or-re-route-alsa-lib-logging
 	// and then https://stackoverflow.com/questions/40576003/ignoring-warning-wunused-result
@@ -81,38 +86,80 @@ void Streams::start(Controller* ctrl) {
     this->in_stream = NULL;
     this->out_stream = NULL;
 
-	Pa_OpenDefaultStream(
-		&(this->in_stream),
-		cfg::CHANNELS, 
-		0, // input only
-		paInt16,
-		cfg::SAMPLERATE,
-		cfg::BLOCKSIZE,
-		in_callback,
-		ctrl
-	);
-
-	Pa_OpenDefaultStream(
-		&(this->out_stream),
-		0, // output only
-		cfg::CHANNELS,
-		paInt16,
-		cfg::SAMPLERATE,
-		cfg::BLOCKSIZE,
-		out_callback,
-		ctrl
-	);
-
-	Pa_StartStream(in_stream);
-	Pa_StartStream(out_stream);
+	if (duplex) {
+		auto err = Pa_OpenDefaultStream(
+			&(this->out_stream),
+			cfg::CHANNELS,
+			cfg::CHANNELS,
+			paInt16,
+			cfg::SAMPLERATE,
+			cfg::BLOCKSIZE,
+			duplex_callback,
+			ctrl
+		);
+		if (err != paNoError) {
+			fprintf(stderr, "Cannot open duplex stream: %s.\n", Pa_GetErrorText(err));
+			this->out_stream = NULL;
+		}
+	} else {
+		auto err = Pa_OpenDefaultStream(
+			&(this->in_stream),
+			cfg::CHANNELS, 
+			0, // input only
+			paInt16,
+			cfg::SAMPLERATE,
+			cfg::BLOCKSIZE,
+			in_callback,
+			ctrl
+		);
+		if (err != paNoError) {
+			fprintf(stderr, "Cannot open input stream: %s.\n", Pa_GetErrorText(err));
+			this->in_stream = NULL;
+		}
+
+		err = Pa_OpenDefaultStream(
+			&(this->out_stream),
+			0, // output only
+			cfg::CHANNELS,
+			paInt16,
+			cfg::SAMPLERATE,
+			cfg::BLOCKSIZE,
+			out_callback,
+			ctrl
+		);
+		if (err != paNoError) {
+			fprintf(stderr, "Cannot open output stream: %s.\n", Pa_GetErrorText(err));
+			this->out_stream = NULL;
+		}
+	}
+
+	auto in_info = (this->in_stream != NULL) ? Pa_GetStreamInfo(this->in_stream) : ((duplex && (this->out_stream != NULL)) ? Pa_GetStreamInfo(this->out_stream) : NULL);
+	auto out_info = (this->out_stream != NULL) ? Pa_GetStreamInfo(this->out_stream) : NULL;
+	this->input_latency = (in_info != NULL) ? in_info->inputLatency : 0.0;
+	this->output_latency = (out_info != NULL) ? out_info->outputLatency : 0.0;
+
+	if (this->in_stream != NULL) {
+		Pa_StartStream(this->in_stream);
+	}
+	if (this->out_stream != NULL) {
+		Pa_StartStream(this->out_stream);
+	}
 }
 
 void Streams::stop() {
-    Pa_StopStream(this->in_stream);
-	Pa_StopStream(this->out_stream);
+	if (this->in_stream != NULL) {
+		Pa_StopStream(this->in_stream);
+	}
+	if (this->out_stream != NULL) {
+		Pa_StopStream(this->out_stream);
+	}
 
-	Pa_CloseStream(this->in_stream);
-	Pa_CloseStream(this->out_stream);
+	if (this->in_stream != NULL) {
+		Pa_CloseStream(this->in_stream);
+	}
+	if (this->out_stream != NULL) {
+		Pa_CloseStream(this->out_stream);
+	}
 
 	Pa_Terminate();
 }
\ No newline at end of file
@@ -7,12 +7,16 @@
 
 class Streams {
 
-    PaStream* in_stream;
-    PaStream* out_stream;
+    PaStream* in_stream; // NULL for duplex, or if failed to open
+    PaStream* out_stream; // NULL if failed to open
 
 public:
 
-    void start(Controller* ctrl);
+    // Latencies reported by PortAudio for opened streams, sec
+    double input_latency = 0.0;
+    double output_latency = 0.0;
+
+    void start(Controller* ctrl, bool duplex);
     void stop();
 
 };
@@ -0,0 +1,77 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Kernels other than reference are chosen for any WEIGHT, and match formulas of kernels.hpp: mix fixed-point only for 2^-k
+
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../config.hpp"
+#include "../kernels.hpp"
+
+using namespace std;
+
+int main() {
+	int failed = 0;
+	for (auto weight : {"0.0625", "0.3"}) {
+		if ((cfg::set("WEIGHT", weight) != 0) || (cfg::derive() != 0)) {
+			return 1;
+		}
+		string isa = kernels::init();
+		if (isa == "reference") {
+			fprintf(stderr, "WEIGHT=%s: reference kernels are chosen.\n", weight);
+			failed = 1;
+		}
+
+		const size_t n = 0x1000 + 5;
+		vector<int16_t> dst(n), input(n);
+		vector<float> power(n);
+		uint32_t r = 1;
+		for (size_t i = 0; i < n; i++) {
+			r = r * 1103515245 + 12345;
+			dst[i] = int16_t(r >> 16);
+			input[i] = int16_t(r);
+			power[i] = float(pow(10.0, -12.0 + 14.0 * (r >> 8) / double(1 << 24)));
+		}
+		auto mixed = dst;
+		kernels::mix(mixed.data(), input.data(), n);
+		vector<uint8_t> lums(n);
+		kernels::quantize(power.data(), lums.data(), n, 1);
+		for (size_t i = 0; i < n; i++) {
+			auto expected_mix = int16_t(cfg::WEIGHT * input[i] + (1.0 - cfg::WEIGHT) * dst[i]);
+			double lum = (-cfg::SPECTRUM_FLOOR_DB / 10 + log10(pow(10.0, cfg::SPECTRUM_FLOOR_DB / 10) + double(power[i]))) / (cfg::SPECTRUM_RANGE_DB / 10);
+			auto expected_lum = uint8_t(0xFF * ((lum > 1.0) ? 1.0 : ((lum < 0.0) ? 0.0 : lum)));
+			if ((mixed[i] != expected_mix) || (lums[i] != expected_lum)) {
+				fprintf(stderr, "WEIGHT=%s: %s kernels differ from formulas at %lu.\n", weight, isa.c_str(), i);
+				failed = 1;
+				break;
+			}
+		}
+	}
+	printf("kernels: %s\n", (failed == 0) ? "ok" : "FAILED");
+	return failed;
+}
@@ -0,0 +1,73 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Silent synth written to block fills all its channels, mono and 4 of ambisonics, and nothing past it, at any layout
+
+#include <fluidsynth.h>
+
+#include <stdio.h>
+#include <vector>
+
+#include "../config.hpp"
+#include "../ensemble.hpp"
+
+static const int16_t GUARD = 0x5A5A;
+
+int main() {
+	int failed = 0;
+	for (auto channels : {"1", "4"}) {
+		for (auto planar : {"0", "1"}) {
+			if ((cfg::set("CHANNELS", channels) != 0) || (cfg::set("PLANAR", planar) != 0) || (cfg::derive() != 0)) {
+				return 1;
+			}
+			auto settings = new_fluid_settings();
+			auto synth = new_fluid_synth(settings);
+
+			size_t n = cfg::BLOCKSIZE * cfg::CHANNELS;
+			vector<int16_t> block(2 * n, GUARD); // 2nd half guards, 1st one is as if left from previous block
+			vector<int16_t> right(2 * cfg::BLOCKSIZE, GUARD);
+			Ensemble::write_synth(synth, block.data(), right.data());
+
+			for (size_t i = 0; i < n; i++) {
+				if (block[i] != 0) { // no notes, so silence
+					fprintf(stderr, "CHANNELS=%s PLANAR=%s: sample %lu of block is not written.\n", channels, planar, i);
+					failed = 1;
+					break;
+				}
+			}
+			for (size_t i = n; i < block.size(); i++) {
+				if ((block[i] != GUARD) || ((i - n < cfg::BLOCKSIZE) && (right[cfg::BLOCKSIZE + i - n] != GUARD))) {
+					fprintf(stderr, "CHANNELS=%s PLANAR=%s: sample %lu past block is overwritten.\n", channels, planar, i);
+					failed = 1;
+					break;
+				}
+			}
+
+			delete_fluid_synth(synth);
+			delete_fluid_settings(settings);
+		}
+	}
+	printf("synth_write: %s\n", (failed == 0) ? "ok" : "FAILED");
+	return failed;
+}
@@ -0,0 +1,356 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstring>
+
+#include "config.hpp"
+#include "tiered.hpp"
+
+// Packed block is a bit stream, least significant bits first. Per channel: 2 bits of predictor order,
+// then per group: 5 bits of Rice parameter k, then per residual (zigzagged to unsigned u): u >> k in unary as 1s and 0,
+// and k low bits of u; if u >> k reaches ESCAPE, it is ESCAPE 1s and RAW_BITS of u instead.
+// Residuals of order 2 are within ±4 * 0x8000, so zigzagged ones take 18 bits at most.
+
+static const uint32_t ESCAPE = 24;
+static const uint32_t RAW_BITS = 18;
+static const uint32_t MAX_K = RAW_BITS - 1;
+
+static inline int32_t predict(size_t order, int32_t x1, int32_t x2) {
+	return (order == 0) ? 0 : ((order == 1) ? x1 : (2 * x1 - x2));
+}
+
+static inline uint32_t zigzag(int32_t e) {
+	return (uint32_t(e) << 1) ^ uint32_t(e >> 31);
+}
+
+struct BitWriter {
+	vector<uint8_t>& out;
+	uint64_t acc = 0;
+	uint32_t n = 0;
+
+	BitWriter(vector<uint8_t>& out) : out(out) {
+	}
+
+	inline void put(uint32_t v, uint32_t n_bits) { // n_bits <= 32
+		this->acc |= uint64_t(v) << this->n;
+		this->n += n_bits;
+		while (this->n >= 8) {
+			this->out.push_back(uint8_t(this->acc));
+			this->acc >>= 8;
+			this->n -= 8;
+		}
+	}
+
+	void flush() {
+		if (this->n > 0) {
+			this->out.push_back(uint8_t(this->acc));
+		}
+	}
+};
+
+struct BitReader {
+	const uint8_t* ptr;
+	const uint8_t* end;
+	uint64_t acc = 0;
+	uint32_t n = 0;
+
+	BitReader(const vector<uint8_t>& in) : ptr(in.data()), end(in.data() + in.size()) {
+	}
+
+	inline void refill() { // to 56 bits at least, zeros past the end
+		while (this->n <= 56) {
+			this->acc |= uint64_t((this->ptr < this->end) ? *(this->ptr) : 0) << this->n;
+			this->ptr++;
+			this->n += 8;
+		}
+	}
+
+	inline uint32_t get(uint32_t n_bits) { // n_bits <= 32
+		this->refill();
+		auto v = uint32_t(this->acc & ((uint64_t(1) << n_bits) - 1));
+		this->acc >>= n_bits;
+		this->n -= n_bits;
+		return v;
+	}
+
+	inline uint32_t get_rice(uint32_t k) {
+		this->refill();
+		auto ones = uint32_t(__builtin_ctzll(~(this->acc)));
+		if (ones >= ESCAPE) {
+			this->acc >>= ESCAPE;
+			this->n -= ESCAPE;
+			return this->get(RAW_BITS);
+		}
+		this->acc >>= ones + 1;
+		this->n -= ones + 1;
+		return (ones << k) | this->get(k);
+	}
+};
+
+// Empty if block is silent
+static void pack(const int16_t* block, vector<uint32_t>& residuals, vector<uint8_t>& out) {
+	out.clear();
+	size_t n = cfg::BLOCKSIZE * cfg::CHANNELS;
+	size_t i_nonzero = 0;
+	while ((i_nonzero < n) && (block[i_nonzero] == 0)) {
+		i_nonzero++;
+	}
+	if (i_nonzero == n) {
+		return;
+	}
+
+	BitWriter writer(out);
+	for (size_t c = 0; c < cfg::CHANNELS; c++) {
+		auto src = block + c * cfg::SAMPLES_LANE;
+
+		// Order of the least sum of residuals
+		uint64_t sums[3] = {0, 0, 0};
+		int32_t x1 = 0;
+		int32_t x2 = 0;
+		for (size_t i = 0; i < cfg::BLOCKSIZE; i++) {
+			int32_t x = src[i * cfg::STRIDE];
+			for (size_t order = 0; order < 3; order++) {
+				sums[order] += zigzag(x - predict(order, x1, x2));
+			}
+			x2 = x1;
+			x1 = x;
+		}
+		size_t order = (sums[1] < sums[0]) ? 1 : 0;
+		if (sums[2] < sums[order]) {
+			order = 2;
+		}
+		writer.put(uint32_t(order), 2);
+
+		x1 = 0;
+		x2 = 0;
+		for (size_t i = 0; i < cfg::BLOCKSIZE; i++) {
+			int32_t x = src[i * cfg::STRIDE];
+			residuals[i] = zigzag(x - predict(order, x1, x2));
+			x2 = x1;
+			x1 = x;
+		}
+
+		for (size_t i_group = 0; i_group < cfg::BLOCKSIZE; i_group += TieredStore::GROUP) {
+			auto group = residuals.data() + i_group;
+			uint64_t sum = 0;
+			for (size_t i = 0; i < TieredStore::GROUP; i++) {
+				sum += group[i];
+			}
+			uint32_t k = 0;
+			while ((k < MAX_K) && ((uint64_t(TieredStore::GROUP) << (k + 1)) <= sum)) {
+				k++;
+			}
+			writer.put(k, 5);
+			for (size_t i = 0; i < TieredStore::GROUP; i++) {
+				auto u = group[i];
+				auto q = u >> k;
+				if (q >= ESCAPE) {
+					writer.put((1 << ESCAPE) - 1, ESCAPE);
+					writer.put(u, RAW_BITS);
+				} else {
+					writer.put((1 << q) - 1, q + 1); // q 1s and 0
+					writer.put(u & ((1 << k) - 1), k);
+				}
+			}
+		}
+	}
+	writer.flush();
+}
+
+static void unpack(const vector<uint8_t>& in, int16_t* block) {
+	if (in.empty()) {
+		memset(block, 0, cfg::BLOCKMEMSIZE);
+		return;
+	}
+
+	BitReader reader(in);
+	for (size_t c = 0; c < cfg::CHANNELS; c++) {
+		auto dst = block + c * cfg::SAMPLES_LANE;
+		size_t order = reader.get(2);
+		int32_t x1 = 0;
+		int32_t x2 = 0;
+		for (size_t i_group = 0; i_group < cfg::BLOCKSIZE; i_group += TieredStore::GROUP) {
+			auto k = reader.get(5);
+			for (size_t i = 0; i < TieredStore::GROUP; i++) {
+				auto u = reader.get_rice(k);
+				auto x = predict(order, x1, x2) + (int32_t(u >> 1) ^ -int32_t(u & 1));
+				*dst = int16_t(x);
+				dst += cfg::STRIDE;
+				x2 = x1;
+				x1 = x;
+			}
+		}
+	}
+}
+
+TieredStore::TieredStore(const atomic<size_t>* pos_blk_read) {
+	this->pos_blk_read = pos_blk_read;
+	this->delay = size_t(cfg::DELAY * cfg::SAMPLERATE) / cfg::BLOCKSIZE;
+
+	// Both windows, and as many left behind since previous tend(); and the emergency one, last
+	size_t n_slots = 4 * (BEHIND + cfg::HOT_BLOCKS);
+	this->slots_memory = vector<int16_t>((n_slots + 1) * cfg::BLOCKSIZE * cfg::CHANNELS);
+	for (size_t i = 0; i < n_slots; i++) {
+		this->free_slots.push_back(this->slots_memory.data() + i * cfg::BLOCKSIZE * cfg::CHANNELS);
+	}
+	this->emergency_slot = this->slots_memory.data() + n_slots * cfg::BLOCKSIZE * cfg::CHANNELS;
+	this->unpacked.reserve(n_slots + 1); // so rescue() does not allocate
+	this->slots = unique_ptr<atomic<int16_t*>[]>(new atomic<int16_t*>[cfg::BLOCKS]);
+	for (size_t i = 0; i < cfg::BLOCKS; i++) {
+		this->slots[i].store(NULL);
+	}
+	this->written = vector<uint8_t>(cfg::BLOCKS, 0);
+	this->packed = vector<vector<uint8_t>>(cfg::BLOCKS);
+	this->residuals = vector<uint32_t>(cfg::BLOCKSIZE);
+	this->n_misses.store(0);
+	this->packed_bytes.store(0);
+
+	this->tend();
+}
+
+bool TieredStore::is_hot(size_t pos_blk, size_t pos_blk_head) const {
+	return (pos_blk + cfg::BLOCKS + BEHIND - pos_blk_head) % cfg::BLOCKS < BEHIND + cfg::HOT_BLOCKS;
+}
+
+void TieredStore::repack(size_t pos_blk, const int16_t* block) {
+	auto n_bytes = this->packed[pos_blk].size();
+	pack(block, this->residuals, this->packed[pos_blk]);
+	this->packed[pos_blk].shrink_to_fit();
+	this->packed_bytes.store(this->packed_bytes.load(memory_order_relaxed) + this->packed[pos_blk].size() - n_bytes, memory_order_relaxed);
+}
+
+int16_t* TieredStore::rescue(size_t pos_blk) {
+	unique_lock<mutex> lock(this->tend_mutex, try_to_lock);
+	if (!lock.owns_lock()) {
+		return NULL;
+	}
+	auto block = this->slots[pos_blk].load(memory_order_relaxed);
+	if ((block != NULL) || !this->emergency_free) { // unpacked by tend() just before locking, or slot is taken
+		return block;
+	}
+	block = this->emergency_slot;
+	this->emergency_free = false;
+	unpack(this->packed[pos_blk], block);
+	this->slots[pos_blk].store(block, memory_order_release);
+	this->unpacked.push_back(pos_blk);
+	return block;
+}
+
+void TieredStore::tend() {
+	lock_guard<mutex> lock(this->tend_mutex);
+	auto pos_blk_read = this->pos_blk_read->load(memory_order_acquire); // blocks written before it was advanced are complete
+	auto pos_blk_write = (pos_blk_read + this->delay) % cfg::BLOCKS;
+
+	for (auto block : this->retired_slots) {
+		if (block == this->emergency_slot) {
+			this->emergency_free = true;
+		} else {
+			this->free_slots.push_back(block);
+		}
+	}
+	this->retired_slots.clear();
+
+	// Pack blocks left behind both heads, if written
+	size_t n_kept = 0;
+	for (size_t i = 0; i < this->unpacked.size(); i++) {
+		auto pos_blk = this->unpacked[i];
+		if (this->is_hot(pos_blk, pos_blk_read) || this->is_hot(pos_blk, pos_blk_write)) {
+			this->unpacked[n_kept] = pos_blk;
+			n_kept++;
+			continue;
+		}
+		auto block = this->slots[pos_blk].load(memory_order_relaxed);
+		this->slots[pos_blk].store(NULL, memory_order_relaxed);
+		if (this->written[pos_blk] != 0) {
+			this->repack(pos_blk, block);
+			this->written[pos_blk] = 0;
+		}
+		this->retired_slots.push_back(block);
+	}
+	this->unpacked.resize(n_kept);
+
+	// Unpack blocks coming to heads, the nearest first
+	for (size_t j = 0; j < cfg::HOT_BLOCKS; j++) {
+		for (auto pos_blk_head : {pos_blk_read, pos_blk_write}) {
+			auto pos_blk = (pos_blk_head + j) % cfg::BLOCKS;
+			if (this->slots[pos_blk].load(memory_order_relaxed) != NULL) {
+				continue;
+			}
+			if (this->free_slots.empty()) {
+				return; // sound thread will miss
+			}
+			auto block = this->free_slots.back();
+			this->free_slots.pop_back();
+			unpack(this->packed[pos_blk], block);
+			this->slots[pos_blk].store(block, memory_order_release);
+			this->unpacked.push_back(pos_blk);
+		}
+	}
+}
+
+void TieredStore::start() {
+	this->tender_stopping = false;
+	this->tender = thread([this]() {
+		unique_lock<mutex> lock(this->tender_mutex);
+		while (!this->tender_cv.wait_for(lock, chrono::microseconds(int64_t(250000 * cfg::HOT_SECONDS)), [this]() { return this->tender_stopping; })) {
+			this->tend();
+		}
+	});
+}
+
+void TieredStore::stop() {
+	if (this->tender.joinable()) {
+		{
+			lock_guard<mutex> lock(this->tender_mutex);
+			this->tender_stopping = true;
+		}
+		this->tender_cv.notify_one();
+		this->tender.join();
+	}
+}
+
+void TieredStore::load(size_t pos_blk, const int16_t* block) {
+	lock_guard<mutex> lock(this->tend_mutex);
+	this->repack(pos_blk, block);
+	auto slot = this->slots[pos_blk].load(memory_order_relaxed);
+	if (slot != NULL) {
+		memcpy(slot, block, cfg::BLOCKMEMSIZE);
+		this->written[pos_blk] = 0;
+	}
+}
+
+void TieredStore::read(size_t pos_blk, int16_t* block) {
+	lock_guard<mutex> lock(this->tend_mutex);
+	auto slot = this->slots[pos_blk].load(memory_order_relaxed);
+	if (slot != NULL) {
+		memcpy(block, slot, cfg::BLOCKMEMSIZE);
+	} else {
+		unpack(this->packed[pos_blk], block);
+	}
+}
+
+TieredStore::~TieredStore() {
+	this->stop();
+}
@@ -0,0 +1,84 @@
+#ifndef _TIERED_HPP
+#define _TIERED_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Samples of echoes of all BLOCKS, in 2 tiers: blocks from BEHIND before each head to HOT_BLOCKS after it are unpacked
+// into slots, the others are packed by lossless codec (per channel, residuals of fixed predictor of order 0…2,
+// Rice-coded by groups of GROUP), silent ones taking nothing. Heads are DELAY apart, so reading one tells both.
+// Sound thread only gets the slot of block at a head, without waiting for locks, and finds none (a miss) if tending lags behind;
+// writing one then decodes the block into the emergency slot, if it is free and tend() is not running, so only reading loses audio.
+// tend() unpacks blocks coming to heads and packs written ones left behind, on own thread after start(),
+// or when called, as offline render does after each block.
+class TieredStore {
+
+	static const size_t BEHIND = 4; // blocks, covering the ones being read and written while heads are sampled
+
+	const atomic<size_t>* pos_blk_read;
+	size_t delay; // blocks from reading head to writing one
+
+	vector<int16_t> slots_memory;
+	vector<int16_t*> free_slots;
+	vector<int16_t*> retired_slots; // left by previous tend(), free at next one, as sound thread may have got them just before
+	int16_t* emergency_slot; // for a miss of writing, retired as the others
+	bool emergency_free = true; // under tend_mutex
+	unique_ptr<atomic<int16_t*>[]> slots; // of each block, NULL if packed
+	vector<uint8_t> written; // since unpacked, set by sound thread, seen and cleared by tend() through reading head
+	vector<vector<uint8_t>> packed; // of each block, empty if silent
+	vector<size_t> unpacked; // positions of blocks having slots
+	vector<uint32_t> residuals; // to avoid allocations in packing
+	mutex tend_mutex; // packed & slots, between tend(), load(), read(), and rescue() that only tries it
+
+	thread tender;
+	mutex tender_mutex;
+	condition_variable tender_cv;
+	bool tender_stopping = false;
+
+	bool is_hot(size_t pos_blk, size_t pos_blk_head) const;
+	void repack(size_t pos_blk, const int16_t* block);
+	int16_t* rescue(size_t pos_blk); // by sound thread, NULL if it would wait
+
+public:
+
+	static const size_t GROUP = 0x20; // residuals of one Rice parameter
+
+	atomic<uint64_t> n_misses; // by sound thread
+	atomic<uint64_t> packed_bytes; // by tend()
+
+	TieredStore(const atomic<size_t>* pos_blk_read); // all silent, and unpacked around heads
+
+	// Block at a head, or NULL if it is packed still (and, with write, could not be rescued); with write, block is packed again when left behind
+	inline int16_t* get(size_t pos_blk, bool write) {
+		auto block = this->slots[pos_blk].load(memory_order_acquire);
+		if (block == NULL) {
+			this->n_misses.store(this->n_misses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+			if (write) {
+				block = this->rescue(pos_blk);
+			}
+		}
+		if ((block != NULL) && write) {
+			this->written[pos_blk] = 1;
+		}
+		return block;
+	}
+
+	void tend();
+	void start(); // tends periodically, 4 times per HOT_SECONDS
+	void stop();
+
+	// Not by sound thread: replace block, e.g. as loaded; copy it, e.g. to checkpoint (those behind writing head only)
+	void load(size_t pos_blk, const int16_t* block);
+	void read(size_t pos_blk, int16_t* block);
+
+	~TieredStore();
+
+};
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "config.hpp"
+#include "timings.hpp"
+
+const char* STAGE_NAMES[] = {
+	"in callback",
+	"out callback",
+	"  features",
+	"  synth render",
+	"  echoes read",
+	"  echoes mix",
+	"analysis: synth",
+	"analysis: echoes",
+};
+
+const char* FLAG_NAMES[] = {
+	"InputOverflow",
+	"InputUnderflow",
+	"OutputOverflow",
+	"OutputUnderflow",
+	"PrimingOutput"
+};
+
+Timings::Timings(size_t n_players) {
+	this->n_stages = Stage::PLAYERS + n_players;
+	this->histograms = unique_ptr<Histogram[]>(new Histogram[this->n_stages]);
+	for (size_t i = 0; i < this->n_stages; i++) {
+		auto& h = this->histograms[i];
+		for (size_t j = 0; j < BINS; j++) {
+			h.bins[j].store(0);
+		}
+		h.count.store(0);
+		h.sum_ns.store(0);
+		h.max_ns.store(0);
+		h.misses.store(0);
+		this->stage_names.push_back((i < Stage::PLAYERS) ? string(STAGE_NAMES[i]) : ("  player " + to_string(i - Stage::PLAYERS) + " react"));
+	}
+	for (size_t i = 0; i < FLAGS_NUM; i++) {
+		this->flags[i].store(0);
+		this->reported_flags[i] = 0;
+	}
+
+	this->deadline_ns = uint64_t(1e9 * cfg::BLOCKSIZE / cfg::SAMPLERATE);
+
+	this->drained_bins = vector<uint64_t>(this->n_stages * BINS, 0);
+	this->drained_sums = vector<uint64_t>(this->n_stages, 0);
+	this->drained_misses = vector<uint64_t>(this->n_stages, 0);
+	this->interval = vector<Summary>(this->n_stages, Summary{0, 0.0, 0.0, 0.0, 0.0, 0.0, 0});
+}
+
+double Timings::bin_top_musec(size_t bin) {
+	if (bin < (2 << SUBBINS_LOG2)) {
+		return 1e-3 * (bin + 1);
+	}
+	size_t shift = (bin >> SUBBINS_LOG2) - 1;
+	size_t sub = bin & ((1 << SUBBINS_LOG2) - 1);
+	return 1e-3 * double(((1 << SUBBINS_LOG2) + sub + 1) << shift);
+}
+
+Timings::Summary Timings::summarize(const uint64_t* bins, uint64_t sum_ns, uint64_t max_ns, uint64_t misses) {
+	Summary s{0, 0.0, 0.0, 0.0, 0.0, 0.0, misses};
+	size_t top_bin = 0;
+	for (size_t j = 0; j < BINS; j++) {
+		if (bins[j] > 0) {
+			s.count += bins[j];
+			top_bin = j;
+		}
+	}
+	if (s.count == 0) {
+		return s;
+	}
+	s.mean_musec = 1e-3 * sum_ns / s.count;
+	double max_musec = min(1e-3 * max_ns, bin_top_musec(top_bin));
+	uint64_t cum = 0;
+	double* ps[] = {&(s.p50_musec), &(s.p99_musec), &(s.p999_musec)};
+	uint64_t ranks[] = {(s.count * 500 + 999) / 1000, (s.count * 990 + 999) / 1000, (s.count * 999 + 999) / 1000};
+	size_t k = 0;
+	for (size_t j = 0; (j < BINS) && (k < 3); j++) {
+		cum += bins[j];
+		while ((k < 3) && (cum >= ranks[k])) {
+			*(ps[k]) = min(bin_top_musec(j), max_musec);
+			k++;
+		}
+	}
+	s.max_musec = max_musec;
+	return s;
+}
+
+void Timings::drain() {
+	vector<uint64_t> bins(BINS);
+	for (size_t i = 0; i < this->n_stages; i++) {
+		auto& h = this->histograms[i];
+		h.count.load(memory_order_acquire);
+		auto drained = this->drained_bins.data() + i * BINS;
+		for (size_t j = 0; j < BINS; j++) {
+			auto b = h.bins[j].load(memory_order_relaxed);
+			bins[j] = b - drained[j];
+			drained[j] = b;
+		}
+		auto sum_ns = h.sum_ns.load(memory_order_relaxed);
+		auto misses = h.misses.load(memory_order_relaxed);
+		this->interval[i] = this->summarize(bins.data(), sum_ns - this->drained_sums[i], h.max_ns.load(memory_order_relaxed), misses - this->drained_misses[i]);
+		this->drained_sums[i] = sum_ns;
+		this->drained_misses[i] = misses;
+	}
+}
+
+Timings::Summary Timings::total(size_t stage) {
+	auto& h = this->histograms[stage];
+	h.count.load(memory_order_acquire);
+	vector<uint64_t> bins(BINS);
+	for (size_t j = 0; j < BINS; j++) {
+		bins[j] = h.bins[j].load(memory_order_relaxed);
+	}
+	return this->summarize(bins.data(), h.sum_ns.load(memory_order_relaxed), h.max_ns.load(memory_order_relaxed), h.misses.load(memory_order_relaxed));
+}
+
+void Timings::report(FILE* f) {
+	double deadline_musec = 1e-3 * this->deadline_ns;
+	fprintf(f, "Timings (µs; deadline %.1f µs per block):\n", deadline_musec);
+	fprintf(f, "%-20s %10s %9s %9s %9s %9s %9s %8s %8s\n", "stage", "count", "mean", "p50", "p99", "p99.9", "max", "p99 %", "misses");
+	for (size_t i = 0; i < this->n_stages; i++) {
+		auto s = this->total(i);
+		fprintf(f, "%-20s %10lu %9.1f %9.1f %9.1f %9.1f %9.1f %8.1f %8lu\n", this->stage_names[i].c_str(), s.count, s.mean_musec, s.p50_musec, s.p99_musec, s.p999_musec, s.max_musec, 100.0 * s.p99_musec / deadline_musec, s.misses);
+	}
+	for (size_t i = 0; i < FLAGS_NUM; i++) {
+		fprintf(f, "%s: %lu\n", FLAG_NAMES[i], this->flags[i].load(memory_order_relaxed));
+	}
+	fflush(f);
+}
+
+void Timings::report_flags(FILE* f) {
+	for (size_t i = 0; i < FLAGS_NUM; i++) {
+		auto n = this->flags[i].load(memory_order_relaxed);
+		if (n != this->reported_flags[i]) {
+			fprintf(f, "\n%s ×%lu\n", FLAG_NAMES[i], n - this->reported_flags[i]);
+			this->reported_flags[i] = n;
+		}
+	}
+}
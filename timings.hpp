@@ -0,0 +1,128 @@
+#ifndef _TIMINGS_HPP
+#define _TIMINGS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Lock-free & allocation-free timing of processing stages in sound callbacks.
+// Each stage has the single writer (the thread of its callback, or of analysis worker), reader is any non-audio thread.
+// Histograms are log-linear: 8 sub-bins per power of 2 nanoseconds, i.e. within 12.5% of value.
+class Timings {
+
+public:
+
+	enum Stage {
+		IN_CALLBACK,
+		OUT_CALLBACK,
+		FEATURES,
+		SYNTH_RENDER,
+		ECHOES_READ,
+		ECHOES_MIX,
+		SYNTH_ANALYSIS, // on analysis worker
+		ECHOES_ANALYSIS, // on analysis worker
+		PLAYERS // first player, others follow
+	};
+
+	enum Flag {
+		INPUT_OVERFLOW,
+		INPUT_UNDERFLOW,
+		OUTPUT_OVERFLOW,
+		OUTPUT_UNDERFLOW,
+		PRIMING_OUTPUT,
+		FLAGS_NUM
+	};
+
+	static const size_t SUBBINS_LOG2 = 3;
+	static const size_t BINS = (65 - SUBBINS_LOG2) << SUBBINS_LOG2;
+
+	struct Summary {
+		uint64_t count;
+		double mean_musec;
+		double p50_musec;
+		double p99_musec;
+		double p999_musec;
+		double max_musec;
+		uint64_t misses;
+	};
+
+private:
+
+	struct Histogram {
+		atomic<uint64_t> bins[BINS];
+		atomic<uint64_t> count;
+		atomic<uint64_t> sum_ns;
+		atomic<uint64_t> max_ns;
+		atomic<uint64_t> misses; // of block deadline
+	};
+
+	size_t n_stages;
+	unique_ptr<Histogram[]> histograms;
+	vector<string> stage_names;
+	atomic<uint64_t> flags[FLAGS_NUM];
+	uint64_t reported_flags[FLAGS_NUM];
+
+	// Snapshot at previous drain(), to get histograms of the interval since then
+	vector<uint64_t> drained_bins;
+	vector<uint64_t> drained_sums;
+	vector<uint64_t> drained_misses;
+
+	static inline size_t bin_of(uint64_t ns) {
+		if (ns < (2 << SUBBINS_LOG2)) {
+			return ns;
+		}
+		size_t msb = 63 - __builtin_clzll(ns);
+		size_t shift = msb - SUBBINS_LOG2;
+		return ((shift + 1) << SUBBINS_LOG2) + ((ns >> shift) & ((1 << SUBBINS_LOG2) - 1));
+	}
+
+	static double bin_top_musec(size_t bin);
+	Summary summarize(const uint64_t* bins, uint64_t sum_ns, uint64_t max_ns, uint64_t misses);
+
+public:
+
+	uint64_t deadline_ns;
+	vector<Summary> interval; // per stage, between the last two drain() calls
+
+	Timings(size_t n_players);
+
+	static inline int64_t now() {
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Records time since t_start for stage, returns the current time to chain consecutive stages
+	inline int64_t lap(size_t stage, int64_t t_start) {
+		auto t = now();
+		auto ns = uint64_t(t - t_start);
+		auto& h = this->histograms[stage];
+		// Single writer, so no read-modify-write instructions needed
+		auto& bin = h.bins[bin_of(ns)];
+		bin.store(bin.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		h.sum_ns.store(h.sum_ns.load(memory_order_relaxed) + ns, memory_order_relaxed);
+		if (ns > h.max_ns.load(memory_order_relaxed)) {
+			h.max_ns.store(ns, memory_order_relaxed);
+		}
+		if (ns > this->deadline_ns) {
+			h.misses.store(h.misses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		}
+		h.count.store(h.count.load(memory_order_relaxed) + 1, memory_order_release);
+		return t;
+	}
+
+	inline void flag(Flag f) {
+		this->flags[f].fetch_add(1, memory_order_relaxed);
+	}
+
+	void drain();
+	Summary total(size_t stage);
+	void report(FILE* f);
+	void report_flags(FILE* f); // only those raised since previous call
+
+};
+
+#endif
\ No newline at end of file
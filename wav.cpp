@@ -0,0 +1,162 @@
+/*
+ReSonat - soft-def players react in real-time to looped echoes of sound input
+by playing notes through MIDI soft-synth to sound output.
+
+https://github.com/sunkware/resonat
+
+Copyright (c) 2024-2025 Sunkware
+
+https://sunkware.org
+
+ReSonat is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ReSonat is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ReSonat. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "config.hpp"
+#include "wav.hpp"
+
+// Little-endian host is assumed, as for run-state files of Echoes
+
+int WavReader::open(const string& path) {
+	this->ifs.open(path, ios::binary | ios::in);
+	if (!this->ifs.is_open()) {
+		return -1;
+	}
+
+	this->ifs.seekg(0, ios::end);
+	size_t file_size = this->ifs.tellg();
+	this->ifs.seekg(0, ios::beg);
+
+	char riff[12];
+	if ((file_size < 12) || !this->ifs.read(riff, 12) || (memcmp(riff, "RIFF", 4) != 0) || (memcmp(riff + 8, "WAVE", 4) != 0)) {
+		// Raw int16
+		this->ifs.seekg(0, ios::beg);
+		this->channels = cfg::CHANNELS;
+		this->samplerate = cfg::SAMPLERATE;
+		this->frames = file_size / (this->channels * sizeof(int16_t));
+	} else {
+		bool fmt_found = false;
+		char chunk_id[4];
+		uint32_t chunk_size;
+		while (true) {
+			if (!this->ifs.read(chunk_id, 4) || !this->ifs.read((char*)&chunk_size, 4)) {
+				return -1; // no data chunk
+			}
+			if (memcmp(chunk_id, "fmt ", 4) == 0) {
+				if (chunk_size < 16) {
+					return -1; // too short for fields below
+				}
+				uint16_t format, n_channels, block_align, bits;
+				uint32_t rate, byte_rate;
+				this->ifs.read((char*)&format, 2);
+				this->ifs.read((char*)&n_channels, 2);
+				this->ifs.read((char*)&rate, 4);
+				this->ifs.read((char*)&byte_rate, 4);
+				this->ifs.read((char*)&block_align, 2);
+				this->ifs.read((char*)&bits, 2);
+				if (!this->ifs || ((format != 1) && (format != 0xFFFE)) || (bits != 16) || (n_channels == 0)) {
+					return -1; // only 16-bit PCM
+				}
+				this->channels = n_channels;
+				this->samplerate = rate;
+				fmt_found = true;
+				this->ifs.seekg(chunk_size - 16 + (chunk_size & 1), ios::cur);
+			} else if (memcmp(chunk_id, "data", 4) == 0) {
+				if (!fmt_found) {
+					return -1;
+				}
+				this->frames = min(size_t(chunk_size), file_size - size_t(this->ifs.tellg())) / (this->channels * sizeof(int16_t));
+				break;
+			} else {
+				this->ifs.seekg(chunk_size + (chunk_size & 1), ios::cur);
+			}
+		}
+	}
+
+	this->frames_left = this->frames;
+	this->frame_buf = vector<int16_t>(this->channels);
+
+	return 0;
+}
+
+size_t WavReader::read(int16_t* output, size_t n_frames) {
+	size_t n_read = min(n_frames, this->frames_left);
+	if (this->channels == cfg::CHANNELS) {
+		this->ifs.read((char*)output, n_read * cfg::CHANNELS * sizeof(int16_t));
+		output += n_read * cfg::CHANNELS;
+	} else {
+		// Missing channels repeat existing ones, extra ones are dropped
+		for (size_t i = 0; i < n_read; i++) {
+			this->ifs.read((char*)this->frame_buf.data(), this->channels * sizeof(int16_t));
+			for (size_t c = 0; c < cfg::CHANNELS; c++) {
+				*output = this->frame_buf[c % this->channels];
+				output++;
+			}
+		}
+	}
+	memset(output, 0, (n_frames - n_read) * cfg::CHANNELS * sizeof(int16_t));
+	this->frames_left -= n_read;
+	return n_read;
+}
+
+void WavReader::close() {
+	this->ifs.close();
+}
+
+static void write_u16(ofstream& ofs, uint16_t value) {
+	ofs.write((char*)&value, sizeof(value));
+}
+
+static void write_u32(ofstream& ofs, uint32_t value) {
+	ofs.write((char*)&value, sizeof(value));
+}
+
+int WavWriter::open(const string& path) {
+	this->ofs.open(path, ios::binary | ios::out);
+	if (!this->ofs.is_open()) {
+		return -1;
+	}
+	this->frames = 0;
+
+	// Sizes are patched at close()
+	this->ofs.write("RIFF", 4);
+	write_u32(this->ofs, 0);
+	this->ofs.write("WAVEfmt ", 8);
+	write_u32(this->ofs, 16);
+	write_u16(this->ofs, 1); // PCM
+	write_u16(this->ofs, cfg::CHANNELS);
+	write_u32(this->ofs, cfg::SAMPLERATE);
+	write_u32(this->ofs, cfg::SAMPLERATE * cfg::CHANNELS * sizeof(int16_t));
+	write_u16(this->ofs, cfg::CHANNELS * sizeof(int16_t));
+	write_u16(this->ofs, 16);
+	this->ofs.write("data", 4);
+	write_u32(this->ofs, 0);
+
+	return 0;
+}
+
+void WavWriter::write(const int16_t* input, size_t n_frames) {
+	this->ofs.write((const char*)input, n_frames * cfg::CHANNELS * sizeof(int16_t));
+	this->frames += n_frames;
+}
+
+void WavWriter::close() {
+	uint32_t data_size = this->frames * cfg::CHANNELS * sizeof(int16_t);
+	this->ofs.seekp(4, ios::beg);
+	write_u32(this->ofs, 36 + data_size);
+	this->ofs.seekp(40, ios::beg);
+	write_u32(this->ofs, data_size);
+	this->ofs.close();
+}
@@ -0,0 +1,45 @@
+#ifndef _WAV_HPP
+#define _WAV_HPP
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Reads 16-bit PCM WAV, or headerless raw int16 with cfg::CHANNELS & cfg::SAMPLERATE,
+// converting channels count to cfg::CHANNELS
+class WavReader {
+
+	ifstream ifs;
+	size_t channels;
+	size_t frames_left;
+	vector<int16_t> frame_buf;
+
+public:
+
+	size_t samplerate;
+	size_t frames;
+
+	int open(const string& path);
+	size_t read(int16_t* output, size_t n_frames); // returns number of frames actually read, rest of output is zeroed
+	void close();
+
+};
+
+// Writes 16-bit PCM WAV with cfg::CHANNELS & cfg::SAMPLERATE
+class WavWriter {
+
+	ofstream ofs;
+	size_t frames;
+
+public:
+
+	int open(const string& path);
+	void write(const int16_t* input, size_t n_frames);
+	void close();
+
+};
+
+#endif
\ No newline at end of file